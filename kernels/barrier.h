@@ -27,14 +27,40 @@ typedef unsigned long uint64_t;
 #define DELAY 1000
 #endif
 
+//status of the non-blocking try_* queue operations (queue_try.h)
+#define QUEUE_OK 0
+#define QUEUE_FULL 1
+#define QUEUE_EMPTY 2
+#define QUEUE_CONTENDED 3       //lost a race, trying again may succeed
+
 #ifndef NOFAILSAFE
 #define TEST_FAILSAFE fail < FAILSAFE
 #else
 #define TEST_FAILSAFE 1
 #endif
 
+//OpenCL 2.0: C11 atomics on the existing uint32_t fields, acquire loads and
+//release stores at device scope; the OpenCL 1.2 atomic_* macros stay the fallback
+#if defined(USE_CL2_ATOMICS) && !defined(__CUDA_ARCH__)
+#if __OPENCL_C_VERSION__ < 200
+#error "USE_CL2_ATOMICS needs -cl-std=CL2.0"
+#endif
+#define CL2_ATOMIC(X) ((volatile atomic_uint *)&(X))
+#define CL2_LOAD(X) atomic_load_explicit(CL2_ATOMIC(X), memory_order_acquire, memory_scope_device)
+#define CL2_STORE(X,Y) atomic_store_explicit(CL2_ATOMIC(X), (Y), memory_order_release, memory_scope_device)
+#define CL2_RMW(OP,X,Y) atomic_##OP##_explicit(CL2_ATOMIC(X), (Y), memory_order_acq_rel, memory_scope_device)
+
+//returns the old value like atomic_cmpxchg
+inline uint32_t cl2_cas(volatile atomic_uint *X, uint32_t Y, uint32_t Z){
+    atomic_compare_exchange_strong_explicit(X, &Y, Z, memory_order_acq_rel, memory_order_acquire, memory_scope_device);
+    return Y;
+}
+#endif
+
 //language specific
-#if defined(ATOMIC_COMPUTE) || defined(ATOMIC_WRITE)
+#if defined(USE_CL2_ATOMICS) && !defined(__CUDA_ARCH__)
+#define VWRITE(X,Y) CL2_STORE(X,Y)
+#elif defined(ATOMIC_COMPUTE) || defined(ATOMIC_WRITE)
 #ifdef __CUDA_ARCH__
 #define VWRITE(X,Y) atomicExch(&(X),Y)
 #else
@@ -44,7 +70,9 @@ typedef unsigned long uint64_t;
 #define VWRITE(X,Y) X=Y
 #endif
 
-#if defined(ATOMIC_COMPUTE)
+#if defined(USE_CL2_ATOMICS) && !defined(__CUDA_ARCH__)
+#define VREAD(X) CL2_LOAD(X)
+#elif defined(ATOMIC_COMPUTE)
 #ifdef __CUDA_ARCH__
 #define VREAD(X) atomicAdd(&(X),0)
 #else
@@ -60,6 +88,16 @@ typedef unsigned long uint64_t;
 #define VOLATILE_WRITE(X,Y) atomicExch((unsigned int *)&(X),Y)
 #define VOLATILE_ADD(X,Y) atomicAdd((unsigned int *)&(X),Y)
 #define VOLATILE_CAS(X,Y,Z) atomicCAS((unsigned int *)&(X),Y,Z)
+#elif defined(USE_CL2_ATOMICS)
+//polling reads become plain acquire loads instead of atomic_add(&X,0)
+#define VOLATILE_READ(X) CL2_LOAD(X)
+#define VOLATILE_WRITE(X,Y) CL2_STORE(X,Y)
+#define VOLATILE_XCHG(X,Y) CL2_RMW(exchange,X,Y)
+#define VOLATILE_ADD(X,Y) CL2_RMW(fetch_add,X,Y)
+#define VOLATILE_SUB(X,Y) CL2_RMW(fetch_sub,X,Y)
+#define VOLATILE_OR(X,Y) CL2_RMW(fetch_or,X,Y)
+#define VOLATILE_INC(X) CL2_RMW(fetch_add,X,1)
+#define VOLATILE_CAS(X,Y,Z) cl2_cas(CL2_ATOMIC(X),Y,Z)
 #else
 #define VOLATILE_READ(X) atomic_add(&(X),0)
 #define VOLATILE_WRITE(X,Y) atomic_xchg(&(X),Y)
@@ -74,6 +112,8 @@ typedef unsigned long uint64_t;
 #ifdef FENCE
 #ifdef __CUDA_ARCH__ //CUDA
 #define THREAD_FENCE __threadfence()
+#elif defined(USE_CL2_ATOMICS)
+#define THREAD_FENCE atomic_work_item_fence(CLK_GLOBAL_MEM_FENCE, memory_order_seq_cst, memory_scope_device)
 #else //OpenCL
 #if defined(NVIDIA)
 #define THREAD_FENCE asm("membar.gl;\n\t")
@@ -201,4 +241,87 @@ inline void full_init(__global volatile barrier_t *b, __local volatile uint32_t
     }
     SYNCTHREADS;
 }
+
+//Occupancy discovery and grid-wide barrier, enabled with -DGRID_BARRIER.
+//Groups that start before the first group closes the discovery window are
+//running at the same time and, without preemption, stay resident, so a
+//barrier over them cannot deadlock. goal holds the entry count and, once
+//closed, GRID_CLOSED; present publishes the final count (the occupant
+//groups). The barrier is hierarchical: a work-group barrier, then one
+//arrival per group leader on even; the last arrival resets even and flips
+//the sense in odd, which the other leaders spin on.
+#define GRID_CLOSED 0x80000000u
+#define GRID_NOT_OCCUPANT 0xFFFFFFFFu
+
+//*group gets the group's occupant index (GRID_NOT_OCCUPANT if it started
+//after the window closed), *groups the co-resident group count
+inline void grid_discover(__global volatile barrier_t *b, __local volatile uint32_t *group,
+                          __local volatile uint32_t *groups, __local volatile uint32_t *sense){
+    if(get_local_id(0) == 0){
+        uint32_t id = GRID_NOT_OCCUPANT;
+        uint32_t seen = VOLATILE_READ(b->goal);
+        while(!(seen & GRID_CLOSED)){
+            uint32_t old = VOLATILE_CAS(b->goal, seen, seen + 1);
+            if(old == seen){ id = seen; break; }
+            seen = old;
+        }
+        if(id == 0){
+            //wait for the groups that are already running, then close
+            const uint32_t total = get_num_groups(0);
+            for(int i=0; i<DELAY && VOLATILE_READ(b->goal) < total; ++i){
+                VOLATILE_ADD(b->leader,1);
+            }
+            VOLATILE_WRITE(b->present, VOLATILE_OR(b->goal, GRID_CLOSED));
+        }
+        while((*groups = VOLATILE_READ(b->present)) == 0) { }
+        *group = id;
+        *sense = 0;
+    }
+    SYNCTHREADS;
+}
+
+//sense-reversing barrier over the occupant groups; a no-op for the others,
+//which the phased kernels keep out of their phases (GRID_OCCUPANT)
+inline void grid_sync(__global volatile barrier_t *b, uint32_t group, uint32_t groups,
+                      __local volatile uint32_t *sense){
+    SYNCTHREADS;
+    if(group != GRID_NOT_OCCUPANT && get_local_id(0) == 0){
+        const uint32_t next = !*sense;
+        *sense = next;
+        mem_fence(CLK_GLOBAL_MEM_FENCE);
+        if(VOLATILE_INC(b->even) == groups - 1){
+            VOLATILE_WRITE(b->even, 0);
+            VOLATILE_WRITE(b->odd, next);
+        }else{
+            while(VOLATILE_READ(b->odd) != next) { }
+        }
+        mem_fence(CLK_GLOBAL_MEM_FENCE);
+    }
+    SYNCTHREADS;
+}
+
+#ifdef GRID_BARRIER
+//after full_init; declares the group's discovery state
+#define GRID_INIT(B) \
+    __global volatile barrier_t * grid_b = (B); \
+    volatile __local uint32_t grid_group; \
+    volatile __local uint32_t grid_groups; \
+    volatile __local uint32_t grid_sense; \
+    grid_discover(grid_b, &grid_group, &grid_groups, &grid_sense);
+#define GRID_SYNC grid_sync(grid_b, grid_group, grid_groups, &grid_sense)
+//phase boundary of the multi-phase kernels
+#define PHASE_SYNC GRID_SYNC
+//only occupant groups run phased work, so every phase is grid-wide;
+//GRID_TID/GRID_THREADS number the occupant work-items contiguously
+#define GRID_OCCUPANT (grid_group != GRID_NOT_OCCUPANT)
+#define GRID_TID (grid_group * get_local_size(0) + get_local_id(0))
+#define GRID_THREADS (grid_groups * get_local_size(0))
+#else
+#define GRID_INIT(B)
+#define GRID_SYNC SYNCTHREADS
+#define PHASE_SYNC SYNCTHREADS
+#define GRID_OCCUPANT 1
+#define GRID_TID get_global_id(0)
+#define GRID_THREADS get_global_size(0)
+#endif
 #endif
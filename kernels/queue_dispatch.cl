@@ -2,11 +2,22 @@
 #include "queue_ms.cl"
 #include "queue_sfq.cl"
 #include "queue_tz.cl"
+#include "queue_wfq.cl"
 // #include "queue_lcrq32.cl"  // Commented out for now due to complexity
 
+// try_enqueue/try_dequeue(_n) for the queue selected with -DUSE_*_QUEUE
+#include "queue_try.h"
+
+// Live queue-depth/progress samples (-DTELEMETRY) and event trace (-DTRACE)
+#include "telemetry.h"
+#include "trace.h"
+
 // Include the generic test kernel
 #include "queue_test_generic.cl"
 
+// Table-driven workloads compiled from workloads/*.wl
+#include "queue_workload.cl"
+
 // #include "lcrqueue32.h"  // Commented out for now
 
 // Barrier initialization kernel - works for all queue types
@@ -155,6 +166,10 @@ kernel void simple_queue_test(__global volatile barrier_t* b,
                 int result = tz_enqueue((__global volatile tz_queue_t*)q,  tid*10+i+1);
                 if (result == 0) ops_completed++;
                 else failures++;
+            #elif defined(USE_WFQ_QUEUE)
+                int result = wfq_enqueue((__global volatile wfq_queue_t*)q,  tid*10+i+1);
+                if (result == 0) ops_completed++;
+                else failures++;
             #endif
         }else if (tid % 2 == 1 && tid < 4) {
             /* consumers (dequeue) */
@@ -164,6 +179,8 @@ kernel void simple_queue_test(__global volatile barrier_t* b,
                 int result = ms_dequeue((__global volatile ms_queue_t*)q, &item);
             #elif defined(USE_TZ_QUEUE)
                 int result = tz_dequeue((__global volatile tz_queue_t*)q, &item);
+            #elif defined(USE_WFQ_QUEUE)
+                int result = wfq_dequeue((__global volatile wfq_queue_t*)q, &item);
             #endif
         }
         
@@ -205,6 +222,8 @@ kernel void validate_queue_logic(__global volatile void* q,
                     result = ms_enqueue((__global volatile ms_queue_t*)q, i);
                 #elif defined(USE_TZ_QUEUE)
                     result = tz_enqueue((__global volatile tz_queue_t*)q, i);
+                #elif defined(USE_WFQ_QUEUE)
+                    result = wfq_enqueue((__global volatile wfq_queue_t*)q, i);
                 #endif
                 attempts++;
                 
@@ -232,6 +251,8 @@ kernel void validate_queue_logic(__global volatile void* q,
                     result = ms_dequeue((__global volatile ms_queue_t*)q, &item);
                 #elif defined(USE_TZ_QUEUE)
                     result = tz_dequeue((__global volatile tz_queue_t*)q, &item);
+                #elif defined(USE_WFQ_QUEUE)
+                    result = wfq_dequeue((__global volatile wfq_queue_t*)q, &item);
                 #endif
                 tries++;
                 
@@ -262,16 +283,22 @@ kernel void contention_pattern_test(__global volatile barrier_t* b,
                                    int pattern_type,
                                    int total_operations)
 {
+    TELEMETRY_INIT(timing_data)
+    TRACE_INIT(timing_data)
     const unsigned int tid = get_global_id(0);
     const unsigned int total_threads = get_global_size(0);
     volatile __local unsigned int group;
     volatile __local unsigned int groups;
     
+    TRACE_BARRIER_ENTER();
     full_init(b, &group, &groups, tid, total_operations);
     SYNCTHREADS;
+    TRACE_BARRIER_EXIT();
     
     volatile uint32_t item;
     uint32_t ops_completed = 0;
+    uint32_t ops_failed = 0;    // gave up after FAILSAFE attempts
+    int result;
     
     switch(pattern_type) {
         case 0: // HIGH_CONTENTION: All threads hammer same operations
@@ -322,26 +349,18 @@ kernel void contention_pattern_test(__global volatile barrier_t* b,
             if (tid < total_threads / 4) {
                 // Producer threads
                 for(int i = 0; i < (total_operations * 3) / (total_threads / 4); i++) {
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + i + 1)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, tid + i + 1)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, tid + i + 1)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_enqueue(q, tid + i + 1));
+                    if(result){ ops_failed++; continue; }
                     ops_completed++;
+                    TELEMETRY_OP(q);
                 }
             } else {
                 // Consumer threads
                 for(int i = 0; i < total_operations / (total_threads * 3 / 4); i++) {
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_dequeue(q, &item));
+                    if(result){ ops_failed++; continue; }
                     ops_completed++;
+                    TELEMETRY_OP(q);
                 }
             }
             break;
@@ -350,26 +369,18 @@ kernel void contention_pattern_test(__global volatile barrier_t* b,
             if (tid < total_threads / 2) {
                 // Producer threads
                 for(int i = 0; i < total_operations / total_threads; i++) {
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + i + 1)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, tid + i + 1)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, tid + i + 1)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_enqueue(q, tid + i + 1));
+                    if(result){ ops_failed++; continue; }
                     ops_completed++;
+                    TELEMETRY_OP(q);
                 }
             } else {
                 // Consumer threads
                 for(int i = 0; i < total_operations / total_threads; i++) {
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_dequeue(q, &item));
+                    if(result){ ops_failed++; continue; }
                     ops_completed++;
+                    TELEMETRY_OP(q);
                 }
             }
             break;
@@ -381,23 +392,13 @@ kernel void contention_pattern_test(__global volatile barrier_t* b,
                 if (wave == w) {
                     for(int i = 0; i < total_operations / total_threads; i++) {
                         if (i % 2 == 0) {
-                            #ifdef USE_SFQ_QUEUE
-                                while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + i + 1)) {}
-                            #elif defined(USE_MS_QUEUE)
-                                while(ms_enqueue((__global volatile ms_queue_t*)q, tid + i + 1)) {}
-                            #elif defined(USE_TZ_QUEUE)
-                                while(tz_enqueue((__global volatile tz_queue_t*)q, tid + i + 1)) {}
-                            #endif
+                            QUEUE_RETRY(result, try_enqueue(q, tid + i + 1));
                         } else {
-                            #ifdef USE_SFQ_QUEUE
-                                while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-                            #elif defined(USE_MS_QUEUE)
-                                while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-                            #elif defined(USE_TZ_QUEUE)
-                                while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-                            #endif
+                            QUEUE_RETRY(result, try_dequeue(q, &item));
                         }
+                        if(result){ ops_failed++; continue; }
                         ops_completed++;
+                        TELEMETRY_OP(q);
                     }
                 }
                 SYNCTHREADS;
@@ -407,7 +408,9 @@ kernel void contention_pattern_test(__global volatile barrier_t* b,
     } // End of switch statement
     
     // Store results
+    TELEMETRY_FLUSH(q);
     metrics[tid] = ops_completed;
+    metrics[total_threads + tid] = ops_failed;
 }
 
 // Test 2: Scheduler Simulation
@@ -418,16 +421,22 @@ kernel void scheduler_simulation(__global volatile barrier_t* b,
                                 int scheduler_type,
                                 int num_tasks)
 {
+    TELEMETRY_INIT(completion_times)
+    TRACE_INIT(completion_times)
     const unsigned int tid = get_global_id(0);
     const unsigned int total_threads = get_global_size(0);
     volatile __local unsigned int group;
     volatile __local unsigned int groups;
     
+    TRACE_BARRIER_ENTER();
     full_init(b, &group, &groups, tid, num_tasks);
     SYNCTHREADS;
+    TRACE_BARRIER_EXIT();
     
     volatile uint32_t task_id;
     uint32_t tasks_processed = 0;
+    uint32_t ops_failed = 0;
+    int result;
     
     switch(scheduler_type) {
         case 0: // WORK_STEALING: Some threads produce tasks, others steal
@@ -435,30 +444,24 @@ kernel void scheduler_simulation(__global volatile barrier_t* b,
                 // Task producers (schedulers)
                 for(int i = 0; i < num_tasks / (total_threads / 4); i++) {
                     uint32_t task = tid * 1000 + i + 1;
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, task)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, task)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, task)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_enqueue(q, task));
+                    if(result){ ops_failed++; continue; }
                     tasks_processed++;
+                    TELEMETRY_OP(q);
                 }
             } else {
                 // Worker threads (steal tasks)
                 for(int attempt = 0; attempt < num_tasks / total_threads; attempt++) {
-                    #ifdef USE_SFQ_QUEUE
-                        if(!my_dequeue_slot((__global volatile my_queue_t*)q, &task_id)) {
-                    #elif defined(USE_MS_QUEUE)
-                        if(!ms_dequeue((__global volatile ms_queue_t*)q, &task_id)) {
-                    #elif defined(USE_TZ_QUEUE)
-                        if(!tz_dequeue((__global volatile tz_queue_t*)q, &task_id)) {
-                    #endif
-                            // Simulate task processing
-                            volatile uint32_t work = task_id;
-                            for(int w = 0; w < 100; w++) work *= (w + 1);
-                            tasks_processed++;
-                        }
+                    // one steal: an empty queue ends the attempt
+                    QUEUE_ATTEMPT(result, try_dequeue(q, &task_id));
+                    if(result == QUEUE_CONTENDED) ops_failed++;
+                    if(result == QUEUE_OK) {
+                        // Simulate task processing
+                        volatile uint32_t work = task_id;
+                        for(int w = 0; w < 100; w++) work *= (w + 1);
+                        tasks_processed++;
+                        TELEMETRY_OP(q);
+                    }
                 }
             }
             break;
@@ -470,22 +473,12 @@ kernel void scheduler_simulation(__global volatile barrier_t* b,
                 
                 if (tid % 2 == 0) {
                     // Enqueue task
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, task)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, task)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, task)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_enqueue(q, task));
+                    if(result){ ops_failed++; continue; }
                 } else {
                     // Process task
-                    #ifdef USE_SFQ_QUEUE
-                        while(my_dequeue_slot((__global volatile my_queue_t*)q, &task_id)) {}
-                    #elif defined(USE_MS_QUEUE)
-                        while(ms_dequeue((__global volatile ms_queue_t*)q, &task_id)) {}
-                    #elif defined(USE_TZ_QUEUE)
-                        while(tz_dequeue((__global volatile tz_queue_t*)q, &task_id)) {}
-                    #endif
+                    QUEUE_RETRY(result, try_dequeue(q, &task_id));
+                    if(result){ ops_failed++; continue; }
                     // Simulate different processing times based on priority
                     uint32_t priority_level = task_id >> 16;
                     volatile uint32_t work = task_id;
@@ -493,11 +486,14 @@ kernel void scheduler_simulation(__global volatile barrier_t* b,
                     for(int w = 0; w < work_amount; w++) work *= (w + 1);
                 }
                 tasks_processed++;
+                TELEMETRY_OP(q);
             }
             break;
     } // End of switch
     
+    TELEMETRY_FLUSH(q);
     task_data[tid] = tasks_processed;
+    task_data[total_threads + tid] = ops_failed;
 }
 
 // Test 3: BFS Graph Traversal Simulation
@@ -508,72 +504,59 @@ kernel void bfs_simulation(__global volatile barrier_t* b,
                           int pattern_id,
                           int num_nodes)
 {
+    TELEMETRY_INIT(timing_data)
+    TRACE_INIT(timing_data)
     const unsigned int tid = get_global_id(0);
     const unsigned int total_threads = get_global_size(0);
     volatile __local unsigned int group;
     volatile __local unsigned int groups;
     
+    TRACE_BARRIER_ENTER();
     full_init(b, &group, &groups, tid, num_nodes);
     SYNCTHREADS;
+    TRACE_BARRIER_EXIT();
     
     // Simple BFS simulation - each thread simulates graph traversal
     volatile uint32_t current_node;
     uint32_t nodes_processed = 0;
+    uint32_t ops_failed = 0; // gave up after FAILSAFE attempts
+    int result;
     
     // Initialize with starting nodes (spread across threads)
     if (tid == 0) {
-        #ifdef USE_SFQ_QUEUE
-            my_enqueue_slot((__global volatile my_queue_t*)q, 1);
-        #elif defined(USE_MS_QUEUE)
-            ms_enqueue((__global volatile ms_queue_t*)q, 1);
-        #elif defined(USE_TZ_QUEUE)
-            tz_enqueue((__global volatile tz_queue_t*)q, 1);
-        #endif
+        QUEUE_RETRY(result, try_enqueue(q, 1));
+        if(result) ops_failed++;
     }
     
     SYNCTHREADS;
     
     // BFS traversal simulation
     for(int iter = 0; iter < num_nodes / total_threads; iter++) {
-        #ifdef USE_SFQ_QUEUE
-            if(!my_dequeue_slot((__global volatile my_queue_t*)q, &current_node)) {
-        #elif defined(USE_MS_QUEUE)
-            if(!ms_dequeue((__global volatile ms_queue_t*)q, &current_node)) {
-        #elif defined(USE_TZ_QUEUE)
-            if(!tz_dequeue((__global volatile tz_queue_t*)q, &current_node)) {
-        #endif
-                nodes_processed++;
-                
-                // Simulate adding neighbors to queue (simplified)
-                uint32_t neighbor1 = (current_node % num_nodes) + 1;
-                uint32_t neighbor2 = ((current_node + 1) % num_nodes) + 1;
-                
-                #ifdef USE_SFQ_QUEUE
-                    if (neighbor1 <= num_nodes && neighbor1 != current_node) {
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, neighbor1)) {}
-                    }
-                    if (neighbor2 <= num_nodes && neighbor2 != current_node) {
-                        while(my_enqueue_slot((__global volatile my_queue_t*)q, neighbor2)) {}
-                    }
-                #elif defined(USE_MS_QUEUE)
-                    if (neighbor1 <= num_nodes && neighbor1 != current_node) {
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, neighbor1)) {}
-                    }
-                    if (neighbor2 <= num_nodes && neighbor2 != current_node) {
-                        while(ms_enqueue((__global volatile ms_queue_t*)q, neighbor2)) {}
-                    }
-                #elif defined(USE_TZ_QUEUE)
-                    if (neighbor1 <= num_nodes && neighbor1 != current_node) {
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, neighbor1)) {}
-                    }
-                    if (neighbor2 <= num_nodes && neighbor2 != current_node) {
-                        while(tz_enqueue((__global volatile tz_queue_t*)q, neighbor2)) {}
-                    }
-                #endif
+        // an empty frontier skips the iteration
+        QUEUE_ATTEMPT(result, try_dequeue(q, &current_node));
+        if(result == QUEUE_CONTENDED) ops_failed++;
+        if(result == QUEUE_OK) {
+            nodes_processed++;
+            TELEMETRY_OP(q);
+            
+            // Simulate adding neighbors to queue (simplified)
+            uint32_t neighbor1 = (current_node % num_nodes) + 1;
+            uint32_t neighbor2 = ((current_node + 1) % num_nodes) + 1;
+            
+            if (neighbor1 <= num_nodes && neighbor1 != current_node) {
+                QUEUE_RETRY(result, try_enqueue(q, neighbor1));
+                if(result) ops_failed++;
+            }
+            if (neighbor2 <= num_nodes && neighbor2 != current_node) {
+                QUEUE_RETRY(result, try_enqueue(q, neighbor2));
+                if(result) ops_failed++;
             }
+        }
     }
     
+    TELEMETRY_FLUSH(q);
     metrics[tid] = nodes_processed;
+    metrics[total_threads + tid] = ops_failed;
 }
 
 // Test 4: Burst Pattern Test
@@ -584,85 +567,79 @@ kernel void burst_pattern_test(__global volatile barrier_t* b,
                               int pattern_type,
                               int total_operations)
 {
+    TELEMETRY_INIT(phase_times)
+    TRACE_INIT(phase_times)
     const unsigned int tid = get_global_id(0);
     const unsigned int total_threads = get_global_size(0);
     volatile __local unsigned int group;
     volatile __local unsigned int groups;
     
+    TRACE_BARRIER_ENTER();
     full_init(b, &group, &groups, tid, total_operations);
     SYNCTHREADS;
+    TRACE_BARRIER_EXIT();
+    GRID_INIT(b)
+    // with -DGRID_BARRIER only the co-resident groups run the phases,
+    // renumbered so the roles split them as they would split the launch
+    const unsigned int ptid = GRID_TID;
+    const unsigned int pthreads = GRID_THREADS;
     
     volatile uint32_t item;
     uint32_t ops_completed = 0;
+    uint32_t ops_failed = 0; // gave up after FAILSAFE attempts
+    int result;
     
-    switch(pattern_type) {
+    if(GRID_OCCUPANT) switch(pattern_type) {
         case 0: // BURST_ENQUEUE: Sudden spike in producers
             for(int phase = 0; phase < 5; phase++) {
+                TRACE_PHASE(phase);
                 if (phase == 2) { // Burst phase - all threads become producers
-                    for(int i = 0; i < total_operations / (total_threads * 2); i++) {
-                        #ifdef USE_SFQ_QUEUE
-                            while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + i + 1)) {}
-                        #elif defined(USE_MS_QUEUE)
-                            while(ms_enqueue((__global volatile ms_queue_t*)q, tid + i + 1)) {}
-                        #elif defined(USE_TZ_QUEUE)
-                            while(tz_enqueue((__global volatile tz_queue_t*)q, tid + i + 1)) {}
-                        #endif
+                    for(int i = 0; i < total_operations / (pthreads * 2); i++) {
+                        QUEUE_RETRY(result, try_enqueue(q, ptid + i + 1));
+                        if(result){ ops_failed++; continue; }
                         ops_completed++;
+                        TELEMETRY_OP(q);
                     }
                 } else { // Normal phase - balanced
-                    if (tid % 2 == 0) {
-                        #ifdef USE_SFQ_QUEUE
-                            while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + phase + 1)) {}
-                        #elif defined(USE_MS_QUEUE)
-                            while(ms_enqueue((__global volatile ms_queue_t*)q, tid + phase + 1)) {}
-                        #elif defined(USE_TZ_QUEUE)
-                            while(tz_enqueue((__global volatile tz_queue_t*)q, tid + phase + 1)) {}
-                        #endif
+                    if (ptid % 2 == 0) {
+                        QUEUE_RETRY(result, try_enqueue(q, ptid + phase + 1));
                     } else {
-                        #ifdef USE_SFQ_QUEUE
-                            while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-                        #elif defined(USE_MS_QUEUE)
-                            while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-                        #elif defined(USE_TZ_QUEUE)
-                            while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-                        #endif
+                        QUEUE_RETRY(result, try_dequeue(q, &item));
+                    }
+                    // no continue here: every work-item must reach PHASE_SYNC
+                    if(result) ops_failed++;
+                    else {
+                        ops_completed++;
+                        TELEMETRY_OP(q);
                     }
-                    ops_completed++;
                 }
-                SYNCTHREADS;
+                PHASE_SYNC;
             }
             break;
             
         case 1: {
             // PERIODIC_LOAD: Regular cycles of high/low activity
             for(int cycle = 0; cycle < 10; cycle++) {
+                TRACE_PHASE(cycle);
                 int activity_level = (cycle % 3 == 0) ? 3 : 1; // High activity every 3rd cycle
                 
                 for(int i = 0; i < activity_level; i++) {
-                    if (tid < total_threads / 2) {
-                        #ifdef USE_SFQ_QUEUE
-                            while(my_enqueue_slot((__global volatile my_queue_t*)q, tid + cycle * 100 + i + 1)) {}
-                        #elif defined(USE_MS_QUEUE)
-                            while(ms_enqueue((__global volatile ms_queue_t*)q, tid + cycle * 100 + i + 1)) {}
-                        #elif defined(USE_TZ_QUEUE)
-                            while(tz_enqueue((__global volatile tz_queue_t*)q, tid + cycle * 100 + i + 1)) {}
-                        #endif
+                    if (ptid < pthreads / 2) {
+                        QUEUE_RETRY(result, try_enqueue(q, ptid + cycle * 100 + i + 1));
                     } else {
-                        #ifdef USE_SFQ_QUEUE
-                            while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-                        #elif defined(USE_MS_QUEUE)
-                            while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-                        #elif defined(USE_TZ_QUEUE)
-                            while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-                        #endif
+                        QUEUE_RETRY(result, try_dequeue(q, &item));
                     }
+                    if(result){ ops_failed++; continue; }
                     ops_completed++;
+                    TELEMETRY_OP(q);
                 }
-                SYNCTHREADS;
+                PHASE_SYNC;
             }
             break;
         }
     } // End of switch
     
+    TELEMETRY_FLUSH(q);
     metrics[tid] = ops_completed;
+    metrics[total_threads + tid] = ops_failed;
 } 
\ No newline at end of file
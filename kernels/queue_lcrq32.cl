@@ -12,7 +12,16 @@
 #define GET_TARGET(H, Q) (H % Q->size)
 
 #pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
+#ifdef USE_CL2_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_extended_atomics : enable
+inline ulong cl2_cas64(volatile atomic_ulong *X, ulong Y, ulong Z){
+    atomic_compare_exchange_strong_explicit(X, &Y, Z, memory_order_acq_rel, memory_order_acquire, memory_scope_device);
+    return Y;
+}
+#define VOLATILE_CAS64(X,Y,Z) cl2_cas64((volatile atomic_ulong *)&(X),Y,Z)
+#else
 #define VOLATILE_CAS64(X,Y,Z) atom_cmpxchg(&(X),Y,Z)
+#endif
 
 
 void set_hazard(volatile __global crq32* q){
@@ -6,12 +6,50 @@
 
 #include "barrier.h"
 
+// MS_WIDE packs a 32-bit node index and a 32-bit ABA tag into one 64-bit
+// word (needs cl_khr_int64_base_atomics); the default packs 16+16 bits and
+// caps the queue at 65535 nodes
+#ifdef MS_WIDE
+#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
+typedef uint ms_index_t;
+typedef ulong ms_word_t;
+#ifdef USE_CL2_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_extended_atomics : enable
+inline ulong ms_cas64(volatile atomic_ulong *X, ulong Y, ulong Z){
+    atomic_compare_exchange_strong_explicit(X, &Y, Z, memory_order_acq_rel, memory_order_acquire, memory_scope_device);
+    return Y;
+}
+#define MS_ATOMIC(X) ((volatile atomic_ulong *)&(X))
+#define MS_READ(X) atomic_load_explicit(MS_ATOMIC(X), memory_order_acquire, memory_scope_device)
+#define MS_VREAD(X) MS_READ(X)
+#define MS_WRITE(X,Y) atomic_store_explicit(MS_ATOMIC(X), (Y), memory_order_release, memory_scope_device)
+#define MS_CAS(X,Y,Z) ms_cas64(MS_ATOMIC(X),Y,Z)
+#else
+#define MS_READ(X) atom_add(&(X), 0UL)
+#define MS_VREAD(X) (X)
+#define MS_WRITE(X,Y) atom_xchg(&(X), (Y))
+#define MS_CAS(X,Y,Z) atom_cmpxchg(&(X),Y,Z)
+#endif
+#else
+// queue_dispatch.cl includes this file for every queue type; only an MS
+// build indexes its nodes with 16 bits
+#if defined(USE_MS_QUEUE) && MY_QUEUE_LENGTH > 65535
+#error "MY_QUEUE_LENGTH above 65535 needs MS_WIDE"
+#endif
+typedef unsigned short ms_index_t;
+typedef unsigned ms_word_t;
+#define MS_READ(X) VOLATILE_READ(X)
+#define MS_VREAD(X) VREAD(X)
+#define MS_WRITE(X,Y) VOLATILE_WRITE(X,Y)
+#define MS_CAS(X,Y,Z) VOLATILE_CAS(X,Y,Z)
+#endif
+
 typedef union {
   struct {
-    volatile unsigned short count;
-    volatile unsigned short ptr;
+    volatile ms_index_t count;
+    volatile ms_index_t ptr;
   } sep;
-  volatile unsigned con;
+  volatile ms_word_t con;
 }ms_pointer_t;
 
 typedef struct {
@@ -51,7 +89,7 @@ inline void unms_set_hazard2(volatile __global ms_queue_t* q){
 }
 
 // Fast node allocation with minimal overhead
-inline unsigned
+inline ms_word_t
 new_node_fast(volatile __global ms_queue_t * q)
 {
     ms_pointer_t ptr = {.sep.count = 0};
@@ -80,7 +118,7 @@ new_node_fast(volatile __global ms_queue_t * q)
                 }
                 
                 if(count == 1) { // Success!
-                    ptr.sep.ptr = (unsigned short)new_node;
+                    ptr.sep.ptr = (ms_index_t)new_node;
                     return ptr.con;
                 }
                 
@@ -97,11 +135,11 @@ new_node_fast(volatile __global ms_queue_t * q)
 }
 
 // Original Michael-Scott CAS helper
-inline unsigned cas(volatile __global uint32_t *X, uint32_t Y, uint32_t Z){
-    return (atomic_cmpxchg(X,Y,Z) == Y);
+inline unsigned cas(volatile __global ms_word_t *X, ms_word_t Y, ms_word_t Z){
+    return (MS_CAS(*X,Y,Z) == Y);
 }
 
-inline unsigned MAKE_LONG(unsigned short node, unsigned short count){
+inline ms_word_t MAKE_LONG(ms_index_t node, ms_index_t count){
     ms_pointer_t set = {.sep.count = count, .sep.ptr = node};
     return set.con;
 }
@@ -113,7 +151,7 @@ ms_enqueue_fast(__global volatile ms_queue_t * smp, unsigned val)
     if (val == 0) return 1; // Quick reject invalid values
     
     unsigned success = FALSE;
-    unsigned node_val;
+    ms_word_t node_val;
     ms_pointer_t tail;
     ms_pointer_t next;
 
@@ -127,15 +165,15 @@ ms_enqueue_fast(__global volatile ms_queue_t * smp, unsigned val)
     // Initialize the new node
     VOLATILE_WRITE(smp->nodes[node].value, val);
     next.con = 0; // NULL
-    VOLATILE_WRITE(smp->nodes[node].next.con, next.con);
+    MS_WRITE(smp->nodes[node].next.con, next.con);
 
     // Classic Michael-Scott enqueue loop with minimal modifications
     while (success == FALSE) {
-        tail.con = VOLATILE_READ(smp->tail.con);
-        next.con = VOLATILE_READ(smp->nodes[tail.sep.ptr].next.con);
+        tail.con = MS_READ(smp->tail.con);
+        next.con = MS_READ(smp->nodes[tail.sep.ptr].next.con);
         ms_set_hazard2(smp, tail.sep.ptr);
         
-        if (tail.con == VREAD(smp->tail.con)) {
+        if (tail.con == MS_VREAD(smp->tail.con)) {
             if (next.sep.ptr == 0) { // NULL
                 success = cas(&smp->nodes[tail.sep.ptr].next.con,
                             next.con,
@@ -171,14 +209,14 @@ ms_dequeue_fast(__global volatile ms_queue_t * smp, volatile unsigned *val)
     ms_pointer_t next;
 
     while(1) {
-        head.con = VOLATILE_READ(smp->head.con);
-        tail.con = VOLATILE_READ(smp->tail.con);
-        next.con = VOLATILE_READ(smp->nodes[head.sep.ptr].next.con);
+        head.con = MS_READ(smp->head.con);
+        tail.con = MS_READ(smp->tail.con);
+        next.con = MS_READ(smp->nodes[head.sep.ptr].next.con);
         
         ms_set_hazard(smp, head.sep.ptr);
         ms_set_hazard2(smp, next.sep.ptr);
         
-        if (VREAD(smp->head.con) == head.con) {
+        if (MS_VREAD(smp->head.con) == head.con) {
             if (head.sep.ptr == tail.sep.ptr) {
                 if (next.sep.ptr == 0) { // NULL - empty queue
                     unms_set_hazard(smp);
@@ -241,4 +279,210 @@ inline int ms_dequeue_batch(__global volatile ms_queue_t * smp, volatile unsigne
         }
     }
     return success_count;
-}
\ No newline at end of file
+}
+// Single attempts for the try_* API (queue_try.h): one pass of the
+// Michael-Scott loop. Node allocation failure is FULL, a lost CAS or a
+// lagging tail (helped along) is CONTENDED.
+
+// Appends the private chain first..last behind the tail with one CAS; the
+// tail tag advances by the chain length so ms_depth stays a node count.
+inline int ms_try_link(__global volatile ms_queue_t * smp, unsigned first, unsigned last, ms_index_t length)
+{
+    int status = QUEUE_CONTENDED;
+    ms_pointer_t tail;
+    ms_pointer_t next;
+
+    tail.con = MS_READ(smp->tail.con);
+    next.con = MS_READ(smp->nodes[tail.sep.ptr].next.con);
+    ms_set_hazard2(smp, tail.sep.ptr);
+
+    if (tail.con == MS_VREAD(smp->tail.con)) {
+        if (next.sep.ptr == 0) { // NULL
+            if (cas(&smp->nodes[tail.sep.ptr].next.con,
+                    next.con,
+                    MAKE_LONG(first, next.sep.count+1))) {
+                cas(&smp->tail.con,
+                    tail.con,
+                    MAKE_LONG(last, tail.sep.count+length));
+                status = QUEUE_OK;
+            }
+        } else {
+            cas(&smp->tail.con,
+                tail.con,
+                MAKE_LONG(next.sep.ptr, tail.sep.count+1));
+        }
+    }
+    unms_set_hazard2(smp);
+    return status;
+}
+
+inline int ms_try_enqueue(__global volatile ms_queue_t * smp, unsigned val)
+{
+    ms_pointer_t node_ptr;
+    node_ptr.con = new_node_fast(smp);
+    if (node_ptr.con == 0) return QUEUE_FULL;
+    unsigned node = node_ptr.sep.ptr;
+
+    VOLATILE_WRITE(smp->nodes[node].value, val);
+    MS_WRITE(smp->nodes[node].next.con, (ms_word_t)0);
+
+    int status = ms_try_link(smp, node, node, 1);
+    if (status != QUEUE_OK)
+        VOLATILE_WRITE(smp->nodes[node].free, FREE_TRUE);
+    unms_set_hazard(smp);
+    return status;
+}
+
+inline int ms_try_dequeue(__global volatile ms_queue_t * smp, volatile unsigned *val)
+{
+    int status = QUEUE_CONTENDED;
+    unsigned value;
+    ms_pointer_t head;
+    ms_pointer_t tail;
+    ms_pointer_t next;
+
+    head.con = MS_READ(smp->head.con);
+    tail.con = MS_READ(smp->tail.con);
+    next.con = MS_READ(smp->nodes[head.sep.ptr].next.con);
+
+    ms_set_hazard(smp, head.sep.ptr);
+    ms_set_hazard2(smp, next.sep.ptr);
+
+    if (MS_VREAD(smp->head.con) == head.con) {
+        if (head.sep.ptr == tail.sep.ptr) {
+            if (next.sep.ptr == 0)
+                status = QUEUE_EMPTY;
+            else
+                cas(&smp->tail.con,
+                    tail.con,
+                    MAKE_LONG(next.sep.ptr, tail.sep.count+1));
+        } else {
+            value = VOLATILE_READ(smp->nodes[next.sep.ptr].value);
+            if (cas(&smp->head.con,
+                    head.con,
+                    MAKE_LONG(next.sep.ptr, head.sep.count+1))) {
+                VOLATILE_WRITE(smp->nodes[head.sep.ptr].free, FREE_TRUE);
+                *val = value;
+                status = QUEUE_OK;
+            }
+        }
+    }
+    unms_set_hazard(smp);
+    unms_set_hazard2(smp);
+    return status;
+}
+
+// Bulk enqueue: the nodes are allocated and linked privately, then the
+// whole chain is published with a single CAS on the last node's next.
+inline int ms_try_enqueue_n(__global volatile ms_queue_t * smp, const uint32_t * items, uint32_t n, uint32_t * done)
+{
+    int status = QUEUE_OK;
+    unsigned first = 0;
+    unsigned last = 0;
+    uint32_t k = 0;
+    *done = 0;
+
+    for (; k < n; k++) {
+        ms_pointer_t node_ptr;
+        node_ptr.con = new_node_fast(smp);
+        if (node_ptr.con == 0) {
+            status = QUEUE_FULL;
+            break;
+        }
+        unsigned node = node_ptr.sep.ptr;
+        VOLATILE_WRITE(smp->nodes[node].value, items[k]);
+        MS_WRITE(smp->nodes[node].next.con, (ms_word_t)0);
+        if (k == 0)
+            first = node;
+        else
+            MS_WRITE(smp->nodes[last].next.con, MAKE_LONG(node, 0));
+        last = node;
+    }
+    if (k == 0)
+        return status;
+
+    int linked = ms_try_link(smp, first, last, (ms_index_t)k);
+    if (linked != QUEUE_OK) {
+        // the chain is still private, hand the nodes back
+        for (unsigned node = first; ; ) {
+            ms_pointer_t next;
+            next.con = MS_READ(smp->nodes[node].next.con);
+            VOLATILE_WRITE(smp->nodes[node].free, FREE_TRUE);
+            if (node == last) break;
+            node = next.sep.ptr;
+        }
+        status = linked;
+        k = 0;
+    }
+    unms_set_hazard(smp);
+    *done = k;
+    return status;
+}
+
+// Bulk dequeue: walks up to n nodes from the head (never past the tail
+// snapshot) and takes them all with a single CAS on the head. The walk is
+// hand over hand: each node is published in the hazard slot the previous
+// one does not hold and the head is re-read before the node is, since
+// nodes are only freed after the head has moved past them.
+inline int ms_try_dequeue_n(__global volatile ms_queue_t * smp, uint32_t * items, uint32_t n, uint32_t * done)
+{
+    int status = QUEUE_CONTENDED;
+    ms_pointer_t head;
+    ms_pointer_t tail;
+    ms_pointer_t next;
+    *done = 0;
+    if (n == 0) return QUEUE_OK;
+
+    head.con = MS_READ(smp->head.con);
+    tail.con = MS_READ(smp->tail.con);
+    next.con = MS_READ(smp->nodes[head.sep.ptr].next.con);
+
+    ms_set_hazard(smp, head.sep.ptr);
+    ms_set_hazard2(smp, next.sep.ptr);
+
+    if (MS_VREAD(smp->head.con) == head.con) {
+        if (head.sep.ptr == tail.sep.ptr) {
+            if (next.sep.ptr == 0)
+                status = QUEUE_EMPTY;
+            else
+                cas(&smp->tail.con,
+                    tail.con,
+                    MAKE_LONG(next.sep.ptr, tail.sep.count+1));
+        } else {
+            unsigned node = head.sep.ptr;
+            uint32_t k = 0;
+            while (k < n && node != tail.sep.ptr) {
+                ms_pointer_t link;
+                link.con = MS_READ(smp->nodes[node].next.con);
+                if (link.sep.ptr == 0) break;
+                if (k & 1)
+                    ms_set_hazard(smp, link.sep.ptr);
+                else
+                    ms_set_hazard2(smp, link.sep.ptr);
+                // a moved head may have freed it, and the CAS would fail
+                if (MS_VREAD(smp->head.con) != head.con) {
+                    k = 0;
+                    break;
+                }
+                node = link.sep.ptr;
+                items[k++] = VOLATILE_READ(smp->nodes[node].value);
+            }
+            if (k > 0 && cas(&smp->head.con,
+                             head.con,
+                             MAKE_LONG(node, head.sep.count+k))) {
+                // free the old head and every node before the new one
+                for (unsigned old = head.sep.ptr; old != node; ) {
+                    ms_pointer_t link;
+                    link.con = MS_READ(smp->nodes[old].next.con);
+                    VOLATILE_WRITE(smp->nodes[old].free, FREE_TRUE);
+                    old = link.sep.ptr;
+                }
+                *done = k;
+                status = k == n ? QUEUE_OK : QUEUE_EMPTY;
+            }
+        }
+    }
+    unms_set_hazard(smp);
+    unms_set_hazard2(smp);
+    return status;
+}
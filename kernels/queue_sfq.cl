@@ -9,10 +9,33 @@
 #define WORK 100
 #endif
 
+// Item/slot storage layout, selected at build time:
+//   SFQ_LAYOUT_SPLIT  - separate items[] and slots[] arrays (two cache lines per op)
+//   SFQ_LAYOUT_AOS    - interleaved {slot,item} pairs
+//   SFQ_LAYOUT_PADDED - {slot,item} pairs padded to a full cache line, head and
+//                       tail on lines of their own
+#define SFQ_LAYOUT_SPLIT 0
+#define SFQ_LAYOUT_AOS 1
+#define SFQ_LAYOUT_PADDED 2
+#ifndef SFQ_LAYOUT
+#define SFQ_LAYOUT SFQ_LAYOUT_SPLIT
+#endif
+// cache line size in 4-byte words, used for padding
+#ifndef SFQ_LINE_WORDS
+#define SFQ_LINE_WORDS 16
+#endif
+// consecutive tickets are spread SFQ_SWIZZLE cells apart; 1 disables the swizzle
+#ifndef SFQ_SWIZZLE
+#define SFQ_SWIZZLE 16
+#endif
+
 #define MY_QUEUE_MASK (MY_QUEUE_LENGTH - 1)
 #define MY_QUEUE_SMASK (UINT_MAX>>(MY_QUEUE_FACTOR - 1))
-#define GET_TARGET(H, Q) ((((H & MY_QUEUE_MASK) % (MY_QUEUE_LENGTH/16))*16) + ((H & MY_QUEUE_MASK) / (MY_QUEUE_LENGTH/16)))
-/*#define GET_TARGET(H, Q) (((H & MY_QUEUE_MASK)))*/
+#if SFQ_SWIZZLE > 1
+#define GET_TARGET(H, Q) ((((H & MY_QUEUE_MASK) % (MY_QUEUE_LENGTH/SFQ_SWIZZLE))*SFQ_SWIZZLE) + ((H & MY_QUEUE_MASK) / (MY_QUEUE_LENGTH/SFQ_SWIZZLE)))
+#else
+#define GET_TARGET(H, Q) (((H & MY_QUEUE_MASK)))
+#endif
 
 /*#define MY_QUEUE_LENGTH 10240*/
 #define NULL_1 UINT_MAX
@@ -65,27 +88,59 @@
 //     }
 // }
 
+#if SFQ_LAYOUT != SFQ_LAYOUT_SPLIT
+typedef struct my_queue_cell
+{
+    volatile uint32_t slot;
+    volatile uint32_t item;
+#if SFQ_LAYOUT == SFQ_LAYOUT_PADDED && SFQ_LINE_WORDS > 2
+    uint32_t pad[SFQ_LINE_WORDS - 2];
+#endif
+} my_queue_cell_t;
+#endif
+
 typedef struct my_queue
 {
     volatile uint32_t head;
+#if SFQ_LAYOUT == SFQ_LAYOUT_PADDED
+    uint32_t pad0[SFQ_LINE_WORDS - 1];
+#endif
     volatile uint32_t tail;
+#if SFQ_LAYOUT == SFQ_LAYOUT_PADDED
+    uint32_t pad1[SFQ_LINE_WORDS - 1];
+#endif
     volatile uint32_t vnull;
     volatile uint32_t done;
+#if SFQ_LAYOUT == SFQ_LAYOUT_SPLIT
     union{
     volatile uint32_t items[MY_QUEUE_LENGTH];
     volatile uint32_t nodes[MY_QUEUE_LENGTH];
     };
     volatile uint32_t slots[MY_QUEUE_LENGTH];
+#else
+#if SFQ_LAYOUT == SFQ_LAYOUT_PADDED && SFQ_LINE_WORDS > 2
+    uint32_t pad2[SFQ_LINE_WORDS - 2];
+#endif
+    my_queue_cell_t cells[MY_QUEUE_LENGTH];
+#endif
 } my_queue_t;
 // typedef my_queue_t tz_queue_t;
 
+#if SFQ_LAYOUT == SFQ_LAYOUT_SPLIT
+#define SFQ_ITEM(Q, T) ((Q)->items[T])
+#define SFQ_SLOT(Q, T) ((Q)->slots[T])
+#else
+#define SFQ_ITEM(Q, T) ((Q)->cells[T].item)
+#define SFQ_SLOT(Q, T) ((Q)->cells[T].slot)
+#endif
+
 
 inline int my_enqueue(__global volatile my_queue_t * q,
                 unsigned int item,
                 __global volatile unsigned int * done){
     unsigned int target = VOLATILE_INC(q->head) % MY_QUEUE_LENGTH;
     unsigned int fail=0;
-    while(VOLATILE_CAS(q->items[target], 0, item) != 0 && TEST_FAILSAFE){
+    while(VOLATILE_CAS(SFQ_ITEM(q, target), 0, item) != 0 && TEST_FAILSAFE){
         /*if(VREAD(q->done) != 0)*/
             /*return 1;*/
         unsigned int worker=0;
@@ -104,7 +159,7 @@ inline int my_dequeue(__global volatile my_queue_t * q, volatile unsigned int *
 {
     unsigned int target = VOLATILE_INC(q->tail) % MY_QUEUE_LENGTH;
     unsigned int fail=0;
-    while((*p = VOLATILE_XCHG(q->items[target], 0)) == 0 && TEST_FAILSAFE){
+    while((*p = VOLATILE_XCHG(SFQ_ITEM(q, target), 0)) == 0 && TEST_FAILSAFE){
         if(VREAD(*done))
             return 1;
         unsigned int worker=0;
@@ -137,7 +192,7 @@ inline int my_enqueue_slot(__global volatile my_queue_t * q,
 #ifndef NOFAILSAFE
     unsigned int fail=0;
 #endif
-    unsigned slot = q->slots[target];
+    unsigned slot = SFQ_SLOT(q, target);
     while(slot != pass){
         unsigned qdone = VOLATILE_READ(q->done);
         /*if(qdone != 0 && tail > qdone)*/
@@ -151,12 +206,12 @@ inline int my_enqueue_slot(__global volatile my_queue_t * q,
             return 2;
         }
 #endif
-        slot = VOLATILE_READ(q->slots[target]);
+        slot = VOLATILE_READ(SFQ_SLOT(q, target));
     }
     /*printf("enqueued %u target=%u\n pass=%u", item, target, pass);*/
-    VWRITE(q->items[target],item);
+    VWRITE(SFQ_ITEM(q, target),item);
     /*VOLATILE_INC(q->slots[target]);*/
-    VOLATILE_WRITE(q->slots[target], (pass+1) & MY_QUEUE_SMASK);
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
     /*VOLATILE_XCHG(q->items[target], item);*/
     return 0;
 }
@@ -172,7 +227,7 @@ inline int my_dequeue_slot(__global volatile my_queue_t * q, volatile unsigned i
     /*printf("dequeueing target=%u pass=%u total=%u\n", target, pass, VOLATILE_INC(q->vnull));*/
     /*if(head > 1)*/
         /*return 1;*/
-    unsigned slot = q->slots[target];
+    unsigned slot = SFQ_SLOT(q, target);
     while(slot != pass){
         volatile unsigned qdone = VREAD(q->done);
         /*mem_fence(CLK_LOCAL_MEM_FENCE);*/
@@ -191,14 +246,14 @@ inline int my_dequeue_slot(__global volatile my_queue_t * q, volatile unsigned i
             return 2;
         }
 #endif
-        slot = VOLATILE_READ(q->slots[target]);
+        slot = VOLATILE_READ(SFQ_SLOT(q, target));
     }
         /*VOLATILE_INC(q->vnull);*/
 
-    *p = VREAD(q->items[target]);
+    *p = VREAD(SFQ_ITEM(q, target));
     /*printf("dequeued %u target=%u pass=%u total=%u\n", *p, target, pass, VOLATILE_INC(q->vnull));*/
     /*VOLATILE_INC(q->slots[target]);*/
-    VOLATILE_WRITE(q->slots[target], (pass+1) & MY_QUEUE_SMASK);
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
     return 0;
 }
 
@@ -212,7 +267,7 @@ inline int my_enqueue_nb_slot(__global volatile my_queue_t * q,
         pass = ((tail >> MY_QUEUE_FACTOR) << 1);
         /*const uint32_t pass = (tail / q->size)*2;*/ //for non power of 2
         /*fprintf(stderr, "enq pass=%u\n", pass);*/
-        if(VOLATILE_READ(q->slots[target]) != pass)
+        if(VOLATILE_READ(SFQ_SLOT(q, target)) != pass)
             return 1;//queue is full, and may have waiting threads
         uint32_t ltail = tail;
         if((ltail = VOLATILE_CAS(q->tail, tail, tail+1)) == tail)
@@ -220,9 +275,9 @@ inline int my_enqueue_nb_slot(__global volatile my_queue_t * q,
         tail = ltail;
     }
   /*fprintf(stderr,"%d: inserting %u\n", omp_get_thread_num(), item);*/
-    VWRITE(q->items[target], item);
+    VWRITE(SFQ_ITEM(q, target), item);
     /*VOLATILE_ADD(q->slots[target], q->adder);*/
-    VOLATILE_WRITE(q->slots[target], (pass+1) & MY_QUEUE_SMASK);
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
     return 0;
 }
 
@@ -237,18 +292,104 @@ int my_dequeue_nb_slot(__global volatile my_queue_t * q, volatile unsigned int *
         pass = (((head >> MY_QUEUE_FACTOR)<<1) + 1);
         /*fprintf(stderr, "deq pass=%u\n", pass);*/
         /*const uint32_t pass = ((head / q->size)*2)+1;*/
-        if(VOLATILE_READ(q->slots[target]) != pass)
+        if(VOLATILE_READ(SFQ_SLOT(q, target)) != pass)
             return 1;//queue is empty, and may have waiting threads
         if((lhead = VOLATILE_CAS(q->head, head, head+1)) == head)
             break;
             head = lhead;
     }
   /*fprintf(stderr,"%d: removing %u\n", omp_get_thread_num(), q->items[target]);*/
-    *p = VREAD(q->items[target]);
-    VOLATILE_WRITE(q->slots[target], (pass+1) & MY_QUEUE_SMASK);
+    *p = VREAD(SFQ_ITEM(q, target));
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
     return 0;
 }
 
+// Single attempts for the try_* API (queue_try.h): one CAS on the ticket
+// counter, never waiting for a cell. A cell that is not ready is reported
+// as FULL/EMPTY when it belongs to the previous lap/has no enqueuer, and
+// as CONTENDED when another operation is still using it.
+inline int my_try_enqueue(__global volatile my_queue_t * q, unsigned int item){
+    const uint32_t tail = VOLATILE_READ(q->tail);
+    const uint32_t target = GET_TARGET(tail, q);
+    const uint32_t pass = (tail >> MY_QUEUE_FACTOR) << 1;
+    const uint32_t slot = VOLATILE_READ(SFQ_SLOT(q, target));
+    if(slot != pass)
+        return slot == ((pass - 1) & MY_QUEUE_SMASK) ? QUEUE_FULL : QUEUE_CONTENDED;
+    if(VOLATILE_CAS(q->tail, tail, tail + 1) != tail)
+        return QUEUE_CONTENDED;
+    VWRITE(SFQ_ITEM(q, target), item);
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
+    return QUEUE_OK;
+}
+
+inline int my_try_dequeue(__global volatile my_queue_t * q, volatile unsigned int * p){
+    const uint32_t head = VOLATILE_READ(q->head);
+    const uint32_t target = GET_TARGET(head, q);
+    const uint32_t pass = ((head >> MY_QUEUE_FACTOR) << 1) + 1;
+    const uint32_t slot = VOLATILE_READ(SFQ_SLOT(q, target));
+    if(slot != pass)
+        return slot == pass - 1 && (int)(VOLATILE_READ(q->tail) - head) <= 0 ? QUEUE_EMPTY : QUEUE_CONTENDED;
+    if(VOLATILE_CAS(q->head, head, head + 1) != head)
+        return QUEUE_CONTENDED;
+    *p = VREAD(SFQ_ITEM(q, target));
+    VOLATILE_WRITE(SFQ_SLOT(q, target), (pass+1) & MY_QUEUE_SMASK);
+    return QUEUE_OK;
+}
+
+// Bulk: count the ready cells from the tail/head, claim them all with one
+// CAS, then fill/drain them. *done items moved, in order.
+inline int my_try_enqueue_n(__global volatile my_queue_t * q, const uint32_t * items, uint32_t n, uint32_t * done){
+    const uint32_t tail = VOLATILE_READ(q->tail);
+    int status = QUEUE_OK;
+    uint32_t k = 0;
+    *done = 0;
+    for(; k < n; k++){
+        const uint32_t pass = ((tail + k) >> MY_QUEUE_FACTOR) << 1;
+        const uint32_t slot = VOLATILE_READ(SFQ_SLOT(q, GET_TARGET((tail + k), q)));
+        if(slot != pass){
+            status = slot == ((pass - 1) & MY_QUEUE_SMASK) ? QUEUE_FULL : QUEUE_CONTENDED;
+            break;
+        }
+    }
+    if(k == 0)
+        return status;
+    if(VOLATILE_CAS(q->tail, tail, tail + k) != tail)
+        return QUEUE_CONTENDED;
+    for(uint32_t i = 0; i < k; i++){
+        const uint32_t target = GET_TARGET((tail + i), q);
+        VWRITE(SFQ_ITEM(q, target), items[i]);
+        VOLATILE_WRITE(SFQ_SLOT(q, target), ((((tail + i) >> MY_QUEUE_FACTOR) << 1) + 1) & MY_QUEUE_SMASK);
+    }
+    *done = k;
+    return status;
+}
+
+inline int my_try_dequeue_n(__global volatile my_queue_t * q, uint32_t * items, uint32_t n, uint32_t * done){
+    const uint32_t head = VOLATILE_READ(q->head);
+    int status = QUEUE_OK;
+    uint32_t k = 0;
+    *done = 0;
+    for(; k < n; k++){
+        const uint32_t pass = (((head + k) >> MY_QUEUE_FACTOR) << 1) + 1;
+        const uint32_t slot = VOLATILE_READ(SFQ_SLOT(q, GET_TARGET((head + k), q)));
+        if(slot != pass){
+            status = slot == pass - 1 && (int)(VOLATILE_READ(q->tail) - (head + k)) <= 0 ? QUEUE_EMPTY : QUEUE_CONTENDED;
+            break;
+        }
+    }
+    if(k == 0)
+        return status;
+    if(VOLATILE_CAS(q->head, head, head + k) != head)
+        return QUEUE_CONTENDED;
+    for(uint32_t i = 0; i < k; i++){
+        const uint32_t target = GET_TARGET((head + i), q);
+        items[i] = VREAD(SFQ_ITEM(q, target));
+        VOLATILE_WRITE(SFQ_SLOT(q, target), ((((head + i) >> MY_QUEUE_FACTOR) << 1) + 2) & MY_QUEUE_SMASK);
+    }
+    *done = k;
+    return status;
+}
+
 // #include "queue_tz.cl"
 // #include "queue_ms.cl"
 /*#include "queue_lcrq.cl"*/
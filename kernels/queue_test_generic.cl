@@ -1,62 +1,77 @@
 #include "barrier.h"
 
-// Generic queue test kernel that works with different queue types
+// Bulk copy benchmark that works with different queue types: input[] is
+// split into chunks of chunk_size ints and every chunk id (+1) travels
+// through the queue. Each group leader enqueues one of its own chunks,
+// dequeues any chunk and the whole work-group copies it to output[]
+// (int4 loads when the chunk is a multiple of 4 ints, coalesced ints
+// otherwise). Both operations go through the try API and give up after
+// FAILSAFE attempts, which skips that round's copy. metrics[group] gets the
+// number of chunks the group copied.
+// timing_data is the telemetry/trace buffer of the throughput kernels; the
+// host passes a zeroed header, so the copy is not sampled.
 kernel void generic_queue_copy_test(__global volatile barrier_t* b,
                                    __global volatile void* q,
-                                   __global volatile int* input,
-                                   __global volatile int* output,
-                                   int num_elements)
+                                   __global const int* input,
+                                   __global int* output,
+                                   __global uint32_t* metrics,
+                                   __global volatile uint64_t* timing_data,
+                                   int num_elements,
+                                   int chunk_size)
 {
+    TELEMETRY_INIT(timing_data)
+    TRACE_INIT(timing_data)
     const unsigned int tid = (get_local_id(1)*get_local_size(0)) + get_local_id(0);
+    const unsigned int local_size = get_local_size(0)*get_local_size(1);
+    const unsigned int chunks = (num_elements + chunk_size - 1) / chunk_size;
     volatile __local unsigned int group;
     volatile __local unsigned int groups;
+    volatile __local unsigned int chunk;
 
-    full_init(b, &group, &groups, tid, num_elements);
+    full_init(b, &group, &groups, tid, chunks);
     SYNCTHREADS;
-    
-    if(group >= groups)
-        return;
-        
-    unsigned int start = group * ((num_elements/groups));
-    unsigned int end = start + ((num_elements/groups)+1);
-    end = group == groups - 1 ? num_elements : end;
-    
-    volatile unsigned int item;
-    
-    for(int i = start + 1; i <= end; ++i) {
-        if(tid == 0) {
-            // Enqueue operation - conditional compilation based on queue type
-            #ifdef USE_MS_QUEUE
-                while(ms_enqueue((__global volatile ms_queue_t*)q, i)) {}
-            #elif defined(USE_SFQ_QUEUE)
-                while(my_enqueue_slot((__global volatile my_queue_t*)q, i)) {}
-            #elif defined(USE_TZ_QUEUE)
-                while(tz_enqueue((__global volatile tz_queue_t*)q, i)) {}
-            #elif defined(USE_LCRQ_QUEUE)
-                while(lcr_enqueue32((__global volatile lcrq32*)q, i)) {}
-            #endif
-            
-            WAIT(&item);
-            
-            // Dequeue operation - conditional compilation based on queue type
-            #ifdef USE_MS_QUEUE
-                while(ms_dequeue((__global volatile ms_queue_t*)q, &item)) {}
-            #elif defined(USE_SFQ_QUEUE)
-                while(my_dequeue_slot((__global volatile my_queue_t*)q, &item)) {}
-            #elif defined(USE_TZ_QUEUE)
-                while(tz_dequeue((__global volatile tz_queue_t*)q, &item)) {}
-            #elif defined(USE_LCRQ_QUEUE)
-                while(lcr_dequeue32((__global volatile lcrq32*)q, &item)) {}
-            #endif
-        }
-        
-        SYNCTHREADS;
-        
-        if(tid == 0) {
-            output[item - 1] = input[item - 1];
-            WAIT(&item);
+
+    unsigned int copied = 0;
+    if(group < groups){
+        unsigned int start = group * (chunks/groups);
+        unsigned int end = group == groups - 1 ? chunks : start + chunks/groups;
+
+        volatile unsigned int item;
+
+        for(unsigned int i = start + 1; i <= end; ++i) {
+            if(tid == 0) {
+                int result;
+                QUEUE_RETRY(result, try_enqueue(q, i));
+                if(result == QUEUE_OK)
+                    QUEUE_RETRY(result, try_dequeue(q, &item));
+                // a give-up leaves the round without a chunk; verification
+                // then reports the chunk that was not copied
+                chunk = result == QUEUE_OK ? item - 1 : chunks;
+            }
+
+            SYNCTHREADS;
+
+            if(chunk >= chunks) {
+                SYNCTHREADS;
+                continue;
+            }
+            const unsigned int base = chunk * chunk_size;
+            const unsigned int len = min((unsigned int)chunk_size, (unsigned int)num_elements - base);
+            if(len % 4 == 0 && chunk_size % 4 == 0) {
+                __global const int4* src = (__global const int4*)(input + base);
+                __global int4* dst = (__global int4*)(output + base);
+                for(unsigned int k = tid; k < len / 4; k += local_size)
+                    dst[k] = src[k];
+            } else {
+                for(unsigned int k = tid; k < len; k += local_size)
+                    output[base + k] = input[base + k];
+            }
+            copied++;
+
+            SYNCTHREADS;
         }
-        
-        SYNCTHREADS;
     }
-}
\ No newline at end of file
+
+    if(tid == 0)
+        metrics[get_group_id(0) + get_group_id(1)*get_num_groups(0)] = copied;
+}
@@ -0,0 +1,48 @@
+// Non-blocking queue API shared by all queue types. Each call makes one
+// native attempt of the selected queue and says why it did not complete:
+//   QUEUE_OK         done
+//   QUEUE_FULL       no room (SFQ cell of the previous lap, no free MS node,
+//                    TZ tail meets head, WFQ segment ring full)
+//   QUEUE_EMPTY      nothing to dequeue
+//   QUEUE_CONTENDED  lost a race with another operation, trying again may
+//                    succeed at once
+// so callers can do other work on FULL/EMPTY instead of spinning. The _n
+// variants move up to n items, *done of them, in order, and return the
+// status that stopped them (QUEUE_OK when all n moved).
+#ifndef QUEUE_TRY_H
+#define QUEUE_TRY_H
+#include "barrier.h"
+
+#if defined(USE_SFQ_QUEUE)
+#define QUEUE_TRY_T my_queue_t
+#define QUEUE_TRY_OP(OP) my_try_##OP
+#elif defined(USE_MS_QUEUE)
+#define QUEUE_TRY_T ms_queue_t
+#define QUEUE_TRY_OP(OP) ms_try_##OP
+#elif defined(USE_TZ_QUEUE)
+#define QUEUE_TRY_T tz_queue_t
+#define QUEUE_TRY_OP(OP) tz_try_##OP
+#elif defined(USE_WFQ_QUEUE)
+#define QUEUE_TRY_T wfq_queue_t
+#define QUEUE_TRY_OP(OP) wfq_try_##OP
+#endif
+
+#ifdef QUEUE_TRY_T
+inline int try_enqueue(__global volatile void * q, uint32_t item){
+    return QUEUE_TRY_OP(enqueue)((__global volatile QUEUE_TRY_T *)q, item);
+}
+
+inline int try_dequeue(__global volatile void * q, volatile uint32_t * item){
+    return QUEUE_TRY_OP(dequeue)((__global volatile QUEUE_TRY_T *)q, item);
+}
+
+inline int try_enqueue_n(__global volatile void * q, const uint32_t * items, uint32_t n, uint32_t * done){
+    return QUEUE_TRY_OP(enqueue_n)((__global volatile QUEUE_TRY_T *)q, items, n, done);
+}
+
+inline int try_dequeue_n(__global volatile void * q, uint32_t * items, uint32_t n, uint32_t * done){
+    return QUEUE_TRY_OP(dequeue_n)((__global volatile QUEUE_TRY_T *)q, items, n, done);
+}
+#endif
+
+#endif
@@ -1,13 +1,121 @@
 #include "barrier.h"
 #include "tzqueue.h"
 
+// Ring index arithmetic; masks instead of % when the length is a power of two
+#if (MY_QUEUE_LENGTH & (MY_QUEUE_LENGTH - 1)) == 0
+#define TZ_WRAP(I) ((I) & (MY_QUEUE_LENGTH - 1))
+#else
+#define TZ_WRAP(I) ((I) % MY_QUEUE_LENGTH)
+#endif
+#define TZ_NEXT(I) TZ_WRAP((I) + 1)
+#define TZ_DIST(FROM, TO) TZ_WRAP((TO) + MY_QUEUE_LENGTH - (FROM))
+#define TZ_IS_NULL(X) ((X) == NULL_0 || (X) == NULL_1)
+
+// Cells loaded per step when searching for the real tail/head: 1 walks one
+// cell at a time, 4 or 8 load uint4/uint8 chunks and only re-validate the
+// tail/head once per chunk
+#ifndef TZ_SCAN_WIDTH
+#define TZ_SCAN_WIDTH 1
+#endif
+
+#define TZ_SCAN_RETRY UINT_MAX
+#define TZ_SCAN_EMPTY (UINT_MAX-1)
+
+#if TZ_SCAN_WIDTH > 1
+#if (MY_QUEUE_LENGTH % TZ_SCAN_WIDTH) != 0
+#error "MY_QUEUE_LENGTH must be a multiple of TZ_SCAN_WIDTH"
+#endif
+#if TZ_SCAN_WIDTH == 8
+#define TZ_VEC uint8
+#define TZ_VLOAD vload8
+#define TZ_VSTORE vstore8
+#define TZ_LANE_IDS ((uint8)(0, 1, 2, 3, 4, 5, 6, 7))
+#elif TZ_SCAN_WIDTH == 4
+#define TZ_VEC uint4
+#define TZ_VLOAD vload4
+#define TZ_VSTORE vstore4
+#define TZ_LANE_IDS ((uint4)(0, 1, 2, 3))
+#else
+#error "TZ_SCAN_WIDTH must be 1, 4 or 8"
+#endif
+
+// Find the first NULL cell at or after start (the real tail). Returns
+// TZ_SCAN_RETRY when the walk reaches the head first or the tail moved.
+inline uint32_t tz_scan_tail(__global volatile tz_queue_t * t, uint32_t te, uint32_t * tt){
+    const uint32_t head = VREAD(t->head);
+    // the scalar walk gives up when the cell before head is still occupied
+    uint32_t limit = TZ_DIST(te, head);
+    if(limit == 0) limit = MY_QUEUE_LENGTH;
+    uint32_t idx = te & ~(uint32_t)(TZ_SCAN_WIDTH - 1);
+    uint32_t first = te & (TZ_SCAN_WIDTH - 1);
+    for(;;){
+        TZ_VEC v = TZ_VLOAD(0, (const __global uint32_t *)&t->nodes[idx]);
+        int hit = any(((v == (TZ_VEC)(NULL_0)) | (v == (TZ_VEC)(NULL_1))) & (TZ_LANE_IDS >= (TZ_VEC)(first)));
+        uint32_t head_dist = TZ_DIST(idx, head);
+        if(hit || (head_dist >= 1 && head_dist <= TZ_SCAN_WIDTH)){
+            uint32_t cells[TZ_SCAN_WIDTH];
+            TZ_VSTORE(v, 0, cells);
+            for(uint32_t lane = first; lane < TZ_SCAN_WIDTH; lane++){
+                if(TZ_IS_NULL(cells[lane])){
+                    *tt = cells[lane];
+                    return idx + lane;
+                }
+                if(TZ_DIST(te, idx + lane) + 1 == limit)
+                    return TZ_SCAN_RETRY;
+            }
+        }
+        if(te != VREAD(t->tail)) return TZ_SCAN_RETRY;
+        idx = TZ_WRAP(idx + TZ_SCAN_WIDTH);
+        first = 0;
+    }
+}
+
+// Find the first occupied cell at or after start (the real head). Returns
+// TZ_SCAN_EMPTY when a NULL is found at the tail, TZ_SCAN_RETRY when the
+// head moved.
+inline uint32_t tz_scan_head(__global volatile tz_queue_t * t, uint32_t th, uint32_t start, uint32_t * tt){
+    uint32_t idx = start & ~(uint32_t)(TZ_SCAN_WIDTH - 1);
+    uint32_t first = start & (TZ_SCAN_WIDTH - 1);
+    for(;;){
+        const uint32_t tail = VREAD(t->tail);
+        TZ_VEC v = TZ_VLOAD(0, (const __global uint32_t *)&t->nodes[idx]);
+        int hit = any(((v != (TZ_VEC)(NULL_0)) & (v != (TZ_VEC)(NULL_1))) & (TZ_LANE_IDS >= (TZ_VEC)(first)));
+        uint32_t tail_lane = TZ_DIST(idx, tail);
+        if(hit || (tail_lane >= first && tail_lane < TZ_SCAN_WIDTH)){
+            uint32_t cells[TZ_SCAN_WIDTH];
+            TZ_VSTORE(v, 0, cells);
+            for(uint32_t lane = first; lane < TZ_SCAN_WIDTH; lane++){
+                if(!TZ_IS_NULL(cells[lane])){
+                    *tt = cells[lane];
+                    return idx + lane;
+                }
+                //two consecutive NULL means EMPTY
+                if(idx + lane == tail)
+                    return TZ_SCAN_EMPTY;
+            }
+        }
+        if(th != VREAD(t->head)) return TZ_SCAN_RETRY;
+        idx = TZ_WRAP(idx + TZ_SCAN_WIDTH);
+        first = 0;
+    }
+}
+#endif
+
 int tz_enqueue_block(__global volatile tz_queue_t * t, uint32_t newnode){
     while(1){
         uint32_t te = VREAD(t->tail);
+#if TZ_SCAN_WIDTH > 1
+        uint32_t tt;
+        //Find the actual tail a chunk at a time
+        uint32_t ate = tz_scan_tail(t, te, &tt);
+        if(ate == TZ_SCAN_RETRY)continue;
+        //The next slot of the tail
+        uint32_t temp = TZ_NEXT(ate);
+#else
         uint32_t ate = te;
         uint32_t tt = VREAD(t->nodes[ate]);
         //The next slot of the tail
-        uint32_t temp = (ate + 1) % MY_QUEUE_LENGTH;
+        uint32_t temp = TZ_NEXT(ate);
         //Find the actual tail
         while(tt != NULL_0 && tt != NULL_1){
             //check consistency
@@ -17,14 +125,15 @@ int tz_enqueue_block(__global volatile tz_queue_t * t, uint32_t newnode){
             //now check the next cell
             tt = VREAD(t->nodes[temp]);
             ate = temp;
-            temp = (ate + 1) % MY_QUEUE_LENGTH;
+            temp = TZ_NEXT(ate);
         }
         if(tt != NULL_0 && tt != NULL_1)continue;
+#endif
         //check the tail's consistency
         if(te != VREAD(t->tail)) continue;
         //check if queue is full
         if(temp == VREAD(t->head)){
-            ate = (temp + 1) % MY_QUEUE_LENGTH;
+            ate = TZ_NEXT(temp);
             tt = VREAD(t->nodes[ate]);
             //the cell after head is OCCUPIED
             if(tt != NULL_0 && tt != NULL_1){
@@ -52,8 +161,15 @@ int tz_enqueue_block(__global volatile tz_queue_t * t, uint32_t newnode){
 int tz_dequeue_block(__global volatile tz_queue_t *t, volatile uint32_t * oldnode){
     do{
         uint32_t th = VREAD(t->head); // read the head
+#if TZ_SCAN_WIDTH > 1
+        uint32_t tt;
+        //find the actual head a chunk at a time
+        uint32_t temp = tz_scan_head(t, th, TZ_NEXT(th), &tt);
+        if(temp == TZ_SCAN_RETRY)continue;
+        if(temp == TZ_SCAN_EMPTY) continue;
+#else
         //here is the one we want to dequeue
-        uint32_t temp = (th + 1) % MY_QUEUE_LENGTH;
+        uint32_t temp = TZ_NEXT(th);
         uint32_t tt = VREAD(t->nodes[temp]);
         //find the actual head after this loop
         while (tt == NULL_0 || tt == NULL_1){
@@ -61,16 +177,17 @@ int tz_dequeue_block(__global volatile tz_queue_t *t, volatile uint32_t * oldnod
            if(th != VREAD(t->head)) break;
            //two consecutive NULL means EMPTY return
            if(temp == VREAD(t->tail)) break;
-           temp = (temp + 1) % MY_QUEUE_LENGTH; // next cell
+           temp = TZ_NEXT(temp); // next cell
            tt = VREAD(t->nodes[temp]);
         }
         if (tt == NULL_0 || tt == NULL_1)continue;
+#endif
         //check the head's consistency
         if(th != VREAD(t->head)) continue;
         //check whether the Queue is empty
         if(temp == VREAD(t->tail)){
             //help the enqueue to update end
-            VOLATILE_CAS(t->tail, temp, (temp + 1) % MY_QUEUE_LENGTH);
+            VOLATILE_CAS(t->tail, temp, TZ_NEXT(temp));
             continue; //try dequeue again
         }
         //if dequeue rewind to 0
@@ -102,10 +219,18 @@ int tz_dequeue_block(__global volatile tz_queue_t *t, volatile uint32_t * oldnod
 int tz_enqueue(__global volatile tz_queue_t * t, uint32_t newnode){
     while(1){
         uint32_t te = VREAD(t->tail);
+#if TZ_SCAN_WIDTH > 1
+        uint32_t tt;
+        //Find the actual tail a chunk at a time
+        uint32_t ate = tz_scan_tail(t, te, &tt);
+        if(ate == TZ_SCAN_RETRY)continue;
+        //The next slot of the tail
+        uint32_t temp = TZ_NEXT(ate);
+#else
         uint32_t ate = te;
         uint32_t tt = VREAD(t->nodes[ate]);
         //The next slot of the tail
-        uint32_t temp = (ate + 1) % MY_QUEUE_LENGTH;
+        uint32_t temp = TZ_NEXT(ate);
         //Find the actual tail
         while(tt != NULL_0 && tt != NULL_1){
             //check consistency
@@ -115,14 +240,15 @@ int tz_enqueue(__global volatile tz_queue_t * t, uint32_t newnode){
             //now check the next cell
             tt = VREAD(t->nodes[temp]);
             ate = temp;
-            temp = (ate + 1) % MY_QUEUE_LENGTH;
+            temp = TZ_NEXT(ate);
         }
         if(tt != NULL_0 && tt != NULL_1)continue;
+#endif
         //check the tail's consistency
         if(te != VREAD(t->tail)) continue;
         //check if queue is full
         if(temp == VREAD(t->head)){
-            ate = (temp + 1) % MY_QUEUE_LENGTH;
+            ate = TZ_NEXT(temp);
             tt = VREAD(t->nodes[ate]);
             //the cell after head is OCCUPIED
             if(tt != NULL_0 && tt != NULL_1)
@@ -149,8 +275,15 @@ int tz_enqueue(__global volatile tz_queue_t * t, uint32_t newnode){
 int tz_dequeue(__global volatile tz_queue_t *t, volatile uint32_t * oldnode){
     do{
         uint32_t th = VREAD(t->head); // read the head
+#if TZ_SCAN_WIDTH > 1
+        uint32_t tt;
+        //find the actual head a chunk at a time
+        uint32_t temp = tz_scan_head(t, th, TZ_NEXT(th), &tt);
+        if(temp == TZ_SCAN_RETRY)continue;
+        if(temp == TZ_SCAN_EMPTY) return 1;
+#else
         //here is the one we want to dequeue
-        uint32_t temp = (th + 1) % MY_QUEUE_LENGTH;
+        uint32_t temp = TZ_NEXT(th);
         uint32_t tt = VREAD(t->nodes[temp]);
         //find the actual head after this loop
         while (tt == NULL_0 || tt == NULL_1){
@@ -158,16 +291,17 @@ int tz_dequeue(__global volatile tz_queue_t *t, volatile uint32_t * oldnode){
            if(th != VREAD(t->head)) break;
            //two consecutive NULL means EMPTY return
            if(temp == VREAD(t->tail)) return 1;
-           temp = (temp + 1) % MY_QUEUE_LENGTH; // next cell
+           temp = TZ_NEXT(temp); // next cell
            tt = VREAD(t->nodes[temp]);
         }
         if (tt == NULL_0 || tt == NULL_1)continue;
+#endif
         //check the head's consistency
         if(th != VREAD(t->head)) continue;
         //check whether the Queue is empty
         if(temp == VREAD(t->tail)){
             //help the enqueue to update end
-            VOLATILE_CAS(t->tail, temp, (temp + 1) % MY_QUEUE_LENGTH);
+            VOLATILE_CAS(t->tail, temp, TZ_NEXT(temp));
             continue; //try dequeue again
         }
         //if dequeue rewind to 0
@@ -196,3 +330,176 @@ int tz_dequeue(__global volatile tz_queue_t *t, volatile uint32_t * oldnode){
     }while(1);
 }
 
+
+//Single attempts for the try_* API (queue_try.h): one pass of
+//tz_enqueue/tz_dequeue, every "try again" becomes QUEUE_CONTENDED.
+//Find the real tail from te: on QUEUE_OK *ate is the first NULL cell
+//(holding *tt) and the cell after it is not the head
+inline int tz_try_find_tail(__global volatile tz_queue_t * t, uint32_t te, uint32_t * ate, uint32_t * tt){
+#if TZ_SCAN_WIDTH > 1
+    *ate = tz_scan_tail(t, te, tt);
+    if(*ate == TZ_SCAN_RETRY) return QUEUE_CONTENDED;
+    uint32_t temp = TZ_NEXT(*ate);
+#else
+    *ate = te;
+    *tt = VREAD(t->nodes[*ate]);
+    uint32_t temp = TZ_NEXT(*ate);
+    while(!TZ_IS_NULL(*tt)){
+        if(te != VREAD(t->tail)) return QUEUE_CONTENDED;
+        //tail meets head on an occupied cell
+        if(temp == VREAD(t->head)) return QUEUE_FULL;
+        *tt = VREAD(t->nodes[temp]);
+        *ate = temp;
+        temp = TZ_NEXT(*ate);
+    }
+#endif
+    if(te != VREAD(t->tail)) return QUEUE_CONTENDED;
+    if(temp == VREAD(t->head)){
+        uint32_t next = TZ_NEXT(temp);
+        uint32_t nt = VREAD(t->nodes[next]);
+        if(!TZ_IS_NULL(nt))
+            return QUEUE_FULL;
+        if(!next)
+            VWRITE(t->vnull,nt);
+        VOLATILE_CAS(t->head, temp, next);
+        return QUEUE_CONTENDED;
+    }
+    return QUEUE_OK;
+}
+
+//Find the real head after th: on QUEUE_OK *temp is the first occupied
+//cell (holding *tt) and it is not the tail
+inline int tz_try_find_head(__global volatile tz_queue_t * t, uint32_t th, uint32_t * temp, uint32_t * tt){
+#if TZ_SCAN_WIDTH > 1
+    *temp = tz_scan_head(t, th, TZ_NEXT(th), tt);
+    if(*temp == TZ_SCAN_RETRY) return QUEUE_CONTENDED;
+    if(*temp == TZ_SCAN_EMPTY) return QUEUE_EMPTY;
+#else
+    *temp = TZ_NEXT(th);
+    *tt = VREAD(t->nodes[*temp]);
+    while(TZ_IS_NULL(*tt)){
+        if(th != VREAD(t->head)) return QUEUE_CONTENDED;
+        if(*temp == VREAD(t->tail)) return QUEUE_EMPTY;
+        *temp = TZ_NEXT(*temp);
+        *tt = VREAD(t->nodes[*temp]);
+    }
+#endif
+    if(th != VREAD(t->head)) return QUEUE_CONTENDED;
+    if(*temp == VREAD(t->tail)){
+        //help the enqueue to update end
+        VOLATILE_CAS(t->tail, *temp, TZ_NEXT(*temp));
+        return QUEUE_CONTENDED;
+    }
+    return QUEUE_OK;
+}
+
+//The NULL a dequeue of cell temp leaves behind (switched on rewind to 0
+//to avoid ABA)
+inline uint32_t tz_cell_null(__global volatile tz_queue_t * t, uint32_t th, uint32_t temp){
+    if(temp)
+        return temp < th ? VREAD(t->nodes[0]) : VREAD(t->vnull);
+    return VREAD(t->vnull) ^ 1;
+}
+
+int tz_try_enqueue(__global volatile tz_queue_t * t, uint32_t newnode){
+    uint32_t te = VREAD(t->tail);
+    uint32_t ate, tt;
+    int status = tz_try_find_tail(t, te, &ate, &tt);
+    if(status != QUEUE_OK) return status;
+    if(te != VREAD(t->tail)) return QUEUE_CONTENDED;
+    if(VOLATILE_CAS(t->nodes[ate], tt, newnode) != tt) return QUEUE_CONTENDED;
+    uint32_t temp = TZ_NEXT(ate);
+    if(temp%2==0)
+        VOLATILE_CAS(t->tail, te, temp);
+    return QUEUE_OK;
+}
+
+int tz_try_dequeue(__global volatile tz_queue_t *t, volatile uint32_t * oldnode){
+    uint32_t th = VREAD(t->head);
+    uint32_t temp, tt;
+    int status = tz_try_find_head(t, th, &temp, &tt);
+    if(status != QUEUE_OK) return status;
+    uint32_t tnull = tz_cell_null(t, th, temp);
+    if(th != VREAD(t->head)) return QUEUE_CONTENDED;
+    if(VOLATILE_CAS(t->nodes[temp], tt, tnull) != tt) return QUEUE_CONTENDED;
+    if(!temp) VWRITE(t->vnull, tnull);
+    if(temp%2 == 0) VOLATILE_CAS(t->head, th, temp);
+    *oldnode = tt;
+    return QUEUE_OK;
+}
+
+//Bulk variants: find the real tail/head once, scan on for the run of
+//free/occupied cells that fits n, then claim that run front to back with
+//one CAS per cell and move tail/head once at the end. A lost cell CAS
+//stops the run there, so the items that moved are still in order. Like
+//the single calls, tail and head only take even indexes.
+int tz_try_enqueue_n(__global volatile tz_queue_t * t, const uint32_t * items, uint32_t n, uint32_t * done){
+    *done = 0;
+    if(n == 0) return QUEUE_OK;
+    uint32_t te = VREAD(t->tail);
+    uint32_t ate, tt;
+    int status = tz_try_find_tail(t, te, &ate, &tt);
+    if(status != QUEUE_OK) return status;
+    //free cells after the real tail, keeping the cell before head empty
+    const uint32_t head = VREAD(t->head);
+    uint32_t k = 1;
+    for(uint32_t idx = TZ_NEXT(ate); k < n; idx = TZ_NEXT(idx), k++){
+        if(TZ_NEXT(idx) == head){ status = QUEUE_FULL; break; }
+        if(!TZ_IS_NULL(VREAD(t->nodes[idx]))){ status = QUEUE_CONTENDED; break; }
+    }
+    uint32_t i = 0;
+    for(uint32_t idx = ate; i < k; idx = TZ_NEXT(idx), i++){
+        uint32_t cell = i == 0 ? tt : VREAD(t->nodes[idx]);
+        if(!TZ_IS_NULL(cell) || te != VREAD(t->tail) ||
+           VOLATILE_CAS(t->nodes[idx], cell, items[i]) != cell){
+            status = QUEUE_CONTENDED;
+            break;
+        }
+    }
+    if(i == 0) return status;
+    //the new tail is the cell after the run, or the last cell of the run
+    //(then even) when that is odd
+    uint32_t last = TZ_WRAP(ate + i - 1);
+    uint32_t end = TZ_NEXT(last);
+    VOLATILE_CAS(t->tail, te, end%2 ? last : end);
+    *done = i;
+    return status;
+}
+
+int tz_try_dequeue_n(__global volatile tz_queue_t * t, uint32_t * items, uint32_t n, uint32_t * done){
+    *done = 0;
+    if(n == 0) return QUEUE_OK;
+    uint32_t th = VREAD(t->head);
+    uint32_t temp, tt;
+    int status = tz_try_find_head(t, th, &temp, &tt);
+    if(status != QUEUE_OK) return status;
+    //occupied cells after the real head, stopping short of the tail so a
+    //lagging tail never points behind the head
+    const uint32_t tail = VREAD(t->tail);
+    uint32_t k = 1;
+    for(uint32_t idx = TZ_NEXT(temp); k < n; idx = TZ_NEXT(idx), k++){
+        if(idx == tail){ status = QUEUE_CONTENDED; break; }
+        if(TZ_IS_NULL(VREAD(t->nodes[idx]))){ status = QUEUE_EMPTY; break; }
+    }
+    uint32_t i = 0;
+    for(uint32_t idx = temp; i < k; idx = TZ_NEXT(idx), i++){
+        uint32_t cell = i == 0 ? tt : VREAD(t->nodes[idx]);
+        //cells past a rewind read the NULL this run left in cell 0
+        uint32_t tnull = tz_cell_null(t, th, idx);
+        if(TZ_IS_NULL(cell) || th != VREAD(t->head) ||
+           VOLATILE_CAS(t->nodes[idx], cell, tnull) != cell){
+            status = QUEUE_CONTENDED;
+            break;
+        }
+        if(!idx) VWRITE(t->vnull, tnull);
+        items[i] = cell;
+    }
+    if(i == 0) return status;
+    //the new head is the last dequeued cell, or the one before when odd
+    uint32_t last = TZ_WRAP(temp + i - 1);
+    if(last%2 && i > 1) last = TZ_WRAP(last + MY_QUEUE_LENGTH - 1);
+    if(last%2 == 0)
+        VOLATILE_CAS(t->head, th, last);
+    *done = i;
+    return status;
+}
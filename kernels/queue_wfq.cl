@@ -0,0 +1,555 @@
+// Wait-free FIFO queue after Yang and Mellor-Crummey, "A Wait-free Queue
+// as Fast as Fetch-and-Add" (PPoPP'16), adapted to 32-bit GPU atomics.
+//
+// Every operation takes a ticket with fetch-and-add on tail (enqueue) or
+// head (dequeue) and meets its partner in cell[ticket]. A dequeuer that
+// arrives first poisons the cell (TOP) and both sides move on to a new
+// ticket. After WFQ_PATIENCE failed fast-path attempts an operation
+// publishes a request in its handle; dequeuers help one peer enqueue
+// request per poisoned cell and one peer dequeue request per successful
+// dequeue, which bounds the steps of every operation.
+//
+// Adaptations:
+//  - cells hold 32-bit values; 0 (BOT) and 0xFFFFFFFF (TOP) are reserved,
+//    items must be neither
+//  - requests are referenced by handle index + 1, request state packs the
+//    pending bit and a 31-bit cell id into one word, so a launch must stay
+//    below 2^31 tickets
+//  - the unbounded list of segments is a ring of WFQ_LAPS segments of
+//    MY_QUEUE_LENGTH cells. Segment s lives in slot s % WFQ_LAPS while
+//    low <= s < low + WFQ_LAPS. Operations pin the segment of the ticket
+//    counter before they take tickets (the hazard pointers of the paper);
+//    once head and tail have passed the oldest segment and nobody pins it,
+//    it is reset for the lap after (wfq_reclaim). A ticket whose segment is
+//    not open yet is given up: an enqueuer reports full, a dequeuer empty,
+//    and the reset poisons the cells of the dequeue tickets given up
+//  - one handle per warp (get_global_id(0) / WARP, warps past WFQ_HANDLES
+//    share). A lane that finds its handle busy with a warp mate's request
+//    returns QUEUE_CONTENDED instead of taking the slow path, so the
+//    blocking operations are wait-free per handle, not per work-item
+#include "barrier.h"
+
+#ifndef MY_QUEUE_LENGTH
+#define MY_QUEUE_LENGTH 4096
+#define MY_QUEUE_FACTOR 12
+#endif
+// segments in the ring, each of MY_QUEUE_LENGTH cells
+#ifndef WFQ_LAPS
+#define WFQ_LAPS 16
+#endif
+#define WFQ_CELLS (MY_QUEUE_LENGTH * WFQ_LAPS)
+// warps with a handle of their own
+#ifndef WFQ_HANDLES
+#define WFQ_HANDLES 1024
+#endif
+// fast-path attempts before an operation asks for help
+#ifndef WFQ_PATIENCE
+#define WFQ_PATIENCE 10
+#endif
+
+#define WFQ_BOT 0
+#define WFQ_TOP 0xFFFFFFFFu
+#define WFQ_PENDING 0x80000000u
+#define WFQ_ID_MASK 0x7FFFFFFFu
+#define WFQ_NONE WFQ_ID_MASK    // request withdrawn, no cell left in the ring
+
+// wfq_help_enq results
+#define WFQ_VALUE 0
+#define WFQ_SKIP 1              // cell is poisoned, try another
+#define WFQ_EMPTY 2
+#define WFQ_NOCELL 3            // segment of the ticket is not open
+
+// ring slot word: lap << 18 | state << 16 | pins. A slot is reset with
+// WFQ_RESET, then opened to dequeuers (which poison the tickets given up
+// while it was closed) and finally to enqueuers
+#define WFQ_OPEN 0
+#define WFQ_DEQ_OPEN 1
+#define WFQ_RESET 2
+#define WFQ_SEG(I) ((I) / MY_QUEUE_LENGTH)
+#define WFQ_LAP(S) (((S) / WFQ_LAPS) & 0x3FFFu)
+#define WFQ_SLOT_LAP(W) ((W) >> 18)
+#define WFQ_SLOT_STATE(W) (((W) >> 16) & 3u)
+#define WFQ_STATE_STEP (1u << 16)
+#define WFQ_NO_SEG 0xFFFFFFFFu
+
+typedef struct wfq_cell
+{
+    volatile uint32_t val;
+    volatile uint32_t enq;      // enqueue request (handle + 1) placed here, BOT or TOP
+    volatile uint32_t deq;      // dequeue request (handle + 1) that took the value, BOT or TOP
+} wfq_cell_t;
+
+typedef struct wfq_queue
+{
+    volatile uint32_t tail;     // next enqueue ticket
+    volatile uint32_t head;     // next dequeue ticket
+    volatile uint32_t low;      // oldest segment in the ring
+    volatile uint32_t ring[WFQ_LAPS];
+    // handles: the lane using it (global id + 1, 0 = free), the published requests...
+    volatile uint32_t owner[WFQ_HANDLES];
+    volatile uint32_t enq_val[WFQ_HANDLES];
+    volatile uint32_t enq_state[WFQ_HANDLES];   // pending | request id, then the claimed cell
+    volatile uint32_t deq_id[WFQ_HANDLES];
+    volatile uint32_t deq_state[WFQ_HANDLES];   // pending | candidate cell
+    // ...and the helping position of their owner (peer handle + 1, 0 = not started)
+    uint32_t enq_peer[WFQ_HANDLES];
+    uint32_t enq_help[WFQ_HANDLES];             // id + 1 of the enqueue request being helped
+    uint32_t deq_peer[WFQ_HANDLES];
+    wfq_cell_t cells[WFQ_CELLS];
+} wfq_queue_t;
+
+#define WFQ_CELL(Q, I) ((Q)->cells[(I) % WFQ_CELLS])
+
+inline uint32_t wfq_handle(){
+    return (uint32_t)(get_global_id(0) / WARP) % WFQ_HANDLES;
+}
+
+inline uint32_t wfq_handles(){
+    return min((uint32_t)((get_global_size(0) + WARP - 1) / WARP), (uint32_t)WFQ_HANDLES);
+}
+
+inline int wfq_own(__global volatile wfq_queue_t * q, uint32_t h){
+    return VOLATILE_CAS(q->owner[h], 0, (uint32_t)get_global_id(0) + 1) == 0;
+}
+
+inline void wfq_release(__global volatile wfq_queue_t * q, uint32_t h){
+    VOLATILE_WRITE(q->owner[h], 0);
+}
+
+inline uint32_t wfq_peer(__global volatile uint32_t * peer, uint32_t h){
+    return peer[h] ? peer[h] - 1 : (h + 1) % wfq_handles();
+}
+
+inline void wfq_next_peer(__global volatile uint32_t * peer, uint32_t h, uint32_t p){
+    peer[h] = (p + 1) % wfq_handles() + 1;
+}
+
+inline void wfq_advance(__global volatile uint32_t * end, uint32_t cid){
+    uint32_t e = VOLATILE_READ(*end);
+    while(e < cid){
+        uint32_t old = VOLATILE_CAS(*end, e, cid);
+        if(old == e)
+            break;
+        e = old;
+    }
+}
+
+// Whether the cell of ticket i is in the ring and open up to state
+// (WFQ_OPEN for enqueuers, WFQ_DEQ_OPEN for dequeuers)
+inline int wfq_usable(__global volatile wfq_queue_t * q, uint32_t i, uint32_t state){
+    const uint32_t w = VOLATILE_READ(q->ring[WFQ_SEG(i) % WFQ_LAPS]);
+    return WFQ_SLOT_LAP(w) == WFQ_LAP(WFQ_SEG(i)) && WFQ_SLOT_STATE(w) <= state;
+}
+
+// Pin segment s if it is in the ring
+inline int wfq_pin(__global volatile wfq_queue_t * q, uint32_t s){
+    __global volatile uint32_t * slot = &q->ring[s % WFQ_LAPS];
+    uint32_t w = VOLATILE_READ(*slot);
+    while(WFQ_SLOT_LAP(w) == WFQ_LAP(s)){
+        const uint32_t old = VOLATILE_CAS(*slot, w, w + 1);
+        if(old == w)
+            return 1;
+        w = old;
+    }
+    return 0;
+}
+
+inline void wfq_unpin(__global volatile wfq_queue_t * q, uint32_t s){
+    VOLATILE_ADD(q->ring[s % WFQ_LAPS], 0xFFFFFFFFu);
+}
+
+// Recycle the oldest segment once head and tail have passed it and nobody
+// pins it: reset its cells for the lap after, let dequeuers in, poison the
+// tickets dequeuers took (and gave up) while it was closed, then open it
+inline void wfq_reclaim(__global volatile wfq_queue_t * q){
+    const uint32_t s = VOLATILE_READ(q->low);
+    const uint32_t end = (s + 1) * MY_QUEUE_LENGTH;
+    if(VOLATILE_READ(q->head) < end || VOLATILE_READ(q->tail) < end)
+        return;
+    __global volatile uint32_t * slot = &q->ring[s % WFQ_LAPS];
+    const uint32_t idle = WFQ_LAP(s) << 18;
+    if(VOLATILE_CAS(*slot, idle, (WFQ_LAP(s + WFQ_LAPS) << 18) | (WFQ_RESET << 16)) != idle)
+        return;
+    VOLATILE_WRITE(q->low, s + 1);
+    const uint32_t first = (s + WFQ_LAPS) * MY_QUEUE_LENGTH;
+    for(uint32_t i = first; i < first + MY_QUEUE_LENGTH; i++){
+        __global volatile wfq_cell_t * c = &WFQ_CELL(q, i);
+        VWRITE(c->val, WFQ_BOT);
+        VWRITE(c->enq, WFQ_BOT);
+        VWRITE(c->deq, WFQ_BOT);
+    }
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    VOLATILE_ADD(*slot, 0u - WFQ_STATE_STEP);
+    const uint32_t taken = min(VOLATILE_READ(q->head), first + MY_QUEUE_LENGTH);
+    for(uint32_t i = first; i < taken; i++){
+        __global volatile wfq_cell_t * c = &WFQ_CELL(q, i);
+        VOLATILE_CAS(c->val, WFQ_BOT, WFQ_TOP);
+        VOLATILE_CAS(c->enq, WFQ_BOT, WFQ_TOP);
+    }
+    VOLATILE_ADD(*slot, 0u - WFQ_STATE_STEP);
+}
+
+// Pin the segment the next ticket of *end falls in, recycling old segments
+// first; WFQ_NO_SEG when that segment is past the ring
+inline uint32_t wfq_enter(__global volatile wfq_queue_t * q, __global volatile uint32_t * end){
+    for(;;){
+        wfq_reclaim(q);
+        const uint32_t s = WFQ_SEG(VOLATILE_READ(*end));
+        if(wfq_pin(q, s))
+            return s;
+        const uint32_t ahead = s - VOLATILE_READ(q->low);
+        // past the ring; otherwise s was recycled under us or low just moved
+        if(ahead >= WFQ_LAPS && ahead < 0x80000000u)
+            return WFQ_NO_SEG;
+    }
+}
+
+inline int wfq_claim(__global volatile uint32_t * state, uint32_t id, uint32_t cell){
+    return VOLATILE_CAS(*state, WFQ_PENDING | id, cell) == (WFQ_PENDING | id);
+}
+
+inline void wfq_enq_commit(__global volatile wfq_queue_t * q, __global volatile wfq_cell_t * c,
+                           uint32_t item, uint32_t cid){
+    wfq_advance(&q->tail, cid + 1);
+    VOLATILE_WRITE(c->val, item);
+}
+
+// 0 = enqueued, 1 = cell poisoned (*cid = its ticket), 2 = cell not open
+inline int wfq_enq_fast(__global volatile wfq_queue_t * q, uint32_t item, uint32_t * cid){
+    const uint32_t i = VOLATILE_INC(q->tail);
+    if(!wfq_usable(q, i, WFQ_OPEN))
+        return 2;
+    if(VOLATILE_CAS(WFQ_CELL(q, i).val, WFQ_BOT, item) == WFQ_BOT)
+        return 0;
+    *cid = i;
+    return 1;
+}
+
+// with handle h held
+inline int wfq_enq_slow(__global volatile wfq_queue_t * q, uint32_t h, uint32_t item, uint32_t cid){
+    VWRITE(q->enq_val[h], item);
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    VOLATILE_WRITE(q->enq_state[h], WFQ_PENDING | cid);
+    do{
+        const uint32_t i = VOLATILE_INC(q->tail);
+        if(!wfq_usable(q, i, WFQ_OPEN)){
+            // withdraw the request unless a helper placed it meanwhile
+            if(VOLATILE_CAS(q->enq_state[h], WFQ_PENDING | cid, WFQ_NONE) == (WFQ_PENDING | cid))
+                return 1;
+            break;
+        }
+        __global volatile wfq_cell_t * c = &WFQ_CELL(q, i);
+        if(VOLATILE_CAS(c->enq, WFQ_BOT, h + 1) == WFQ_BOT && VREAD(c->val) == WFQ_BOT){
+            wfq_claim(&q->enq_state[h], cid, i);
+            break;
+        }
+    }while(VOLATILE_READ(q->enq_state[h]) & WFQ_PENDING);
+    const uint32_t id = VOLATILE_READ(q->enq_state[h]) & WFQ_ID_MASK;
+    wfq_enq_commit(q, &WFQ_CELL(q, id), item, id);
+    return 0;
+}
+
+// Called by the dequeuer of ticket i: take the value of the cell, or poison
+// it and place a pending peer enqueue request there instead. Peers are
+// helped from handle h, which the caller holds if held is set; otherwise
+// it is taken for the step, and a lane that cannot take it only poisons
+inline int wfq_help_enq(__global volatile wfq_queue_t * q, uint32_t h, int held, uint32_t i, uint32_t * item){
+    if(!wfq_usable(q, i, WFQ_DEQ_OPEN))
+        return WFQ_NOCELL;
+    __global volatile wfq_cell_t * c = &WFQ_CELL(q, i);
+    uint32_t val = VOLATILE_CAS(c->val, WFQ_BOT, WFQ_TOP);
+    if(val != WFQ_BOT && val != WFQ_TOP){
+        *item = val;
+        return WFQ_VALUE;
+    }
+    if(VREAD(c->enq) == WFQ_BOT && (held || wfq_own(q, h))){
+        uint32_t p = 0, s = 0;
+        for(;;){
+            p = wfq_peer(q->enq_peer, h);
+            s = VOLATILE_READ(q->enq_state[p]);
+            // stay on the peer until the request we failed to place is done
+            if(q->enq_help[h] == 0 || q->enq_help[h] == (s & WFQ_ID_MASK) + 1)
+                break;
+            q->enq_help[h] = 0;
+            wfq_next_peer(q->enq_peer, h, p);
+        }
+        if((s & WFQ_PENDING) && (s & WFQ_ID_MASK) <= i && VOLATILE_CAS(c->enq, WFQ_BOT, p + 1) != WFQ_BOT)
+            q->enq_help[h] = (s & WFQ_ID_MASK) + 1;
+        else
+            wfq_next_peer(q->enq_peer, h, p);
+        if(!held)
+            wfq_release(q, h);
+    }
+    // no request for this cell: keep later helpers out
+    if(VREAD(c->enq) == WFQ_BOT)
+        VOLATILE_CAS(c->enq, WFQ_BOT, WFQ_TOP);
+    const uint32_t e = VOLATILE_READ(c->enq);
+    if(e == WFQ_TOP)
+        return VOLATILE_READ(q->tail) <= i ? WFQ_EMPTY : WFQ_SKIP;
+    // a request sits in the cell: commit it here if it is still pending
+    const uint32_t r = e - 1;
+    const uint32_t id = VOLATILE_READ(q->enq_state[r]) & WFQ_ID_MASK;
+    const uint32_t v = VREAD(q->enq_val[r]);
+    if(id > i){
+        if(VREAD(c->val) == WFQ_TOP && VOLATILE_READ(q->tail) <= i)
+            return WFQ_EMPTY;
+    }else if(wfq_claim(&q->enq_state[r], id, i) ||
+             (VOLATILE_READ(q->enq_state[r]) == i && VREAD(c->val) == WFQ_TOP)){
+        wfq_enq_commit(q, c, v, i);
+    }
+    val = VREAD(c->val);
+    if(val == WFQ_TOP)
+        return WFQ_SKIP;
+    *item = val;
+    return WFQ_VALUE;
+}
+
+// Find a cell for the dequeue request of helpee and claim it, with handle h
+// held. The helpee itself runs this from the slow path (self set) and
+// withdraws its request when the search runs past the ring.
+inline void wfq_help_deq(__global volatile wfq_queue_t * q, uint32_t h, uint32_t helpee, int self){
+    uint32_t s = VOLATILE_READ(q->deq_state[helpee]);
+    const uint32_t id = VREAD(q->deq_id[helpee]);
+    if(!(s & WFQ_PENDING) || (s & WFQ_ID_MASK) < id)
+        return;
+    // keep the cells from the request on from being recycled under us
+    const uint32_t seg = WFQ_SEG(id);
+    if(!wfq_pin(q, seg))
+        return;
+    s = VOLATILE_READ(q->deq_state[helpee]);
+    uint32_t prior = id, i = id, cand = 0;
+    for(;;){
+        // look for a candidate until one is found or announced by another helper
+        int past = 0;
+        while(!cand && (s & WFQ_ID_MASK) == prior){
+            uint32_t v;
+            ++i;
+            int r = wfq_help_enq(q, h, 1, i, &v);
+            if(r == WFQ_NOCELL){
+                past = 1;
+                break;
+            }
+            if(r == WFQ_EMPTY || (r == WFQ_VALUE && VREAD(WFQ_CELL(q, i).deq) == WFQ_BOT))
+                cand = i;
+            else
+                s = VOLATILE_READ(q->deq_state[helpee]);
+        }
+        if(past){
+            // a cell past the ring may still get a value: rescan it unless withdrawn
+            if(!self || !(s & WFQ_PENDING) || VOLATILE_CAS(q->deq_state[helpee], s, WFQ_NONE) == s)
+                break;
+            s = VOLATILE_READ(q->deq_state[helpee]);
+            --i;
+        }
+        if(cand){
+            VOLATILE_CAS(q->deq_state[helpee], WFQ_PENDING | prior, WFQ_PENDING | cand);
+            s = VOLATILE_READ(q->deq_state[helpee]);
+        }
+        if(!(s & WFQ_PENDING) || VREAD(q->deq_id[helpee]) != id)
+            break;
+        const uint32_t idx = s & WFQ_ID_MASK;
+        __global volatile wfq_cell_t * c = &WFQ_CELL(q, idx);
+        // the announced cell lets the request return empty, or holds its value
+        if(VREAD(c->val) == WFQ_TOP || VOLATILE_CAS(c->deq, WFQ_BOT, helpee + 1) == WFQ_BOT ||
+           VREAD(c->deq) == helpee + 1){
+            VOLATILE_CAS(q->deq_state[helpee], s, idx);
+            break;
+        }
+        prior = idx;
+        if(idx >= i){
+            cand = 0;
+            i = idx;
+        }
+    }
+    wfq_unpin(q, seg);
+}
+
+// 0 = dequeued, 1 = cell poisoned (*cid = its ticket), 2 = empty or cell
+// not open (the reset of its segment poisons it)
+inline int wfq_deq_fast(__global volatile wfq_queue_t * q, uint32_t h, uint32_t * item, uint32_t * cid){
+    const uint32_t i = VOLATILE_INC(q->head);
+    int r = wfq_help_enq(q, h, 0, i, item);
+    if(r == WFQ_EMPTY || r == WFQ_NOCELL)
+        return 2;
+    if(r == WFQ_VALUE && VOLATILE_CAS(WFQ_CELL(q, i).deq, WFQ_BOT, WFQ_TOP) == WFQ_BOT)
+        return 0;
+    *cid = i;
+    return 1;
+}
+
+// with handle h held
+inline int wfq_deq_slow(__global volatile wfq_queue_t * q, uint32_t h, uint32_t cid, uint32_t * item){
+    VWRITE(q->deq_id[h], cid);
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    VOLATILE_WRITE(q->deq_state[h], WFQ_PENDING | cid);
+    wfq_help_deq(q, h, h, 1);
+    const uint32_t i = VOLATILE_READ(q->deq_state[h]) & WFQ_ID_MASK;
+    if(i == WFQ_NONE)
+        return 2;
+    const uint32_t val = VREAD(WFQ_CELL(q, i).val);
+    wfq_advance(&q->head, i + 1);
+    if(val == WFQ_TOP)
+        return 2;
+    *item = val;
+    return 0;
+}
+
+// after a successful dequeue: help one peer dequeue if the handle is free
+inline void wfq_help_next_deq(__global volatile wfq_queue_t * q, uint32_t h){
+    if(!wfq_own(q, h))
+        return;
+    const uint32_t peer = wfq_peer(q->deq_peer, h);
+    wfq_help_deq(q, h, peer, 0);
+    wfq_next_peer(q->deq_peer, h, peer);
+    wfq_release(q, h);
+}
+
+// QUEUE_OK, QUEUE_FULL (ring full) or QUEUE_CONTENDED (patience used up
+// while a warp mate holds the handle)
+inline int wfq_enqueue(__global volatile wfq_queue_t * q, unsigned int item){
+    const uint32_t h = wfq_handle();
+    const uint32_t seg = wfq_enter(q, &q->tail);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_FULL;
+    uint32_t cid = 0;
+    int r = 1;
+    for(int p = WFQ_PATIENCE; p >= 0 && r == 1; p--)
+        r = wfq_enq_fast(q, item, &cid);
+    int status = r == 0 ? QUEUE_OK : QUEUE_FULL;
+    if(r == 1){
+        if(wfq_own(q, h)){
+            status = wfq_enq_slow(q, h, item, cid) ? QUEUE_FULL : QUEUE_OK;
+            wfq_release(q, h);
+        }else{
+            status = QUEUE_CONTENDED;
+        }
+    }
+    wfq_unpin(q, seg);
+    return status;
+}
+
+// QUEUE_OK, QUEUE_EMPTY or QUEUE_CONTENDED (as for wfq_enqueue)
+inline int wfq_dequeue(__global volatile wfq_queue_t * q, volatile unsigned int * p){
+    const uint32_t h = wfq_handle();
+    // polling an empty queue must not use up tickets
+    if(VOLATILE_READ(q->head) >= VOLATILE_READ(q->tail))
+        return QUEUE_EMPTY;
+    const uint32_t seg = wfq_enter(q, &q->head);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_EMPTY;
+    uint32_t item = 0, cid = 0;
+    int r = 1;
+    for(int n = WFQ_PATIENCE; n >= 0 && r == 1; n--)
+        r = wfq_deq_fast(q, h, &item, &cid);
+    int status = r == 0 ? QUEUE_OK : QUEUE_EMPTY;
+    if(r == 1){
+        if(wfq_own(q, h)){
+            status = wfq_deq_slow(q, h, cid, &item) ? QUEUE_EMPTY : QUEUE_OK;
+            wfq_release(q, h);
+        }else{
+            status = QUEUE_CONTENDED;
+        }
+    }
+    if(status == QUEUE_OK){
+        *p = item;
+        wfq_help_next_deq(q, h);
+    }
+    wfq_unpin(q, seg);
+    return status;
+}
+
+// Tickets below head already have a dequeuer, which poisons the cell
+// unless an enqueuer got there first. An enqueue attempt moves tail past
+// them instead of burning one of them per retry; their dequeuers then
+// report a poisoned cell rather than empty.
+inline void wfq_skip_taken(__global volatile wfq_queue_t * q){
+    const uint32_t head = VOLATILE_READ(q->head);
+    if(VOLATILE_READ(q->tail) < head)
+        wfq_advance(&q->tail, head);
+}
+
+// Single attempts for the try_* API (queue_try.h): one fast-path ticket,
+// never a published request. The ticket is taken past the cells dequeuers
+// hold, so CONTENDED means a dequeuer overtook this very ticket.
+inline int wfq_try_enqueue(__global volatile wfq_queue_t * q, unsigned int item){
+    const uint32_t seg = wfq_enter(q, &q->tail);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_FULL;
+    wfq_skip_taken(q);
+    uint32_t cid;
+    const int r = wfq_enq_fast(q, item, &cid);
+    wfq_unpin(q, seg);
+    return r == 0 ? QUEUE_OK : r == 2 ? QUEUE_FULL : QUEUE_CONTENDED;
+}
+inline int wfq_try_dequeue(__global volatile wfq_queue_t * q, volatile unsigned int * p){
+    const uint32_t h = wfq_handle();
+    if(VOLATILE_READ(q->head) >= VOLATILE_READ(q->tail))
+        return QUEUE_EMPTY;
+    const uint32_t seg = wfq_enter(q, &q->head);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_EMPTY;
+    uint32_t item = 0, cid;
+    const int r = wfq_deq_fast(q, h, &item, &cid);
+    if(r == 0){
+        *p = item;
+        wfq_help_next_deq(q, h);
+    }
+    wfq_unpin(q, seg);
+    return r == 0 ? QUEUE_OK : r == 2 ? QUEUE_EMPTY : QUEUE_CONTENDED;
+}
+// Bulk: one fetch-and-add takes n tickets; the items go, in order, into
+// the cells that are not poisoned, the rest is left to the caller.
+inline int wfq_try_enqueue_n(__global volatile wfq_queue_t * q, const uint32_t * items, uint32_t n, uint32_t * done){
+    uint32_t k = 0;
+    int status = QUEUE_CONTENDED;
+    *done = 0;
+    if(n == 0)
+        return QUEUE_OK;
+    const uint32_t seg = wfq_enter(q, &q->tail);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_FULL;
+    wfq_skip_taken(q);
+    const uint32_t first = VOLATILE_ADD(q->tail, n);
+    for(uint32_t i = first; i < first + n && k < n; i++){
+        if(!wfq_usable(q, i, WFQ_OPEN)){
+            status = QUEUE_FULL;
+            break;
+        }
+        if(VOLATILE_CAS(WFQ_CELL(q, i).val, WFQ_BOT, items[k]) == WFQ_BOT)
+            k++;
+    }
+    wfq_unpin(q, seg);
+    *done = k;
+    return k == n ? QUEUE_OK : status;
+}
+// takes at most as many tickets as the queue held when it was checked
+inline int wfq_try_dequeue_n(__global volatile wfq_queue_t * q, uint32_t * items, uint32_t n, uint32_t * done){
+    const uint32_t h = wfq_handle();
+    const uint32_t head = VOLATILE_READ(q->head);
+    const uint32_t tail = VOLATILE_READ(q->tail);
+    int status = QUEUE_CONTENDED;
+    uint32_t k = 0;
+    *done = 0;
+    if(n == 0)
+        return QUEUE_OK;
+    if(head >= tail)
+        return QUEUE_EMPTY;
+    const uint32_t seg = wfq_enter(q, &q->head);
+    if(seg == WFQ_NO_SEG)
+        return QUEUE_EMPTY;
+    const uint32_t take = min(n, tail - head);
+    const uint32_t first = VOLATILE_ADD(q->head, take);
+    for(uint32_t i = first; i < first + take; i++){
+        uint32_t item;
+        const int r = wfq_help_enq(q, h, 0, i, &item);
+        if(r == WFQ_EMPTY || r == WFQ_NOCELL)
+            status = QUEUE_EMPTY;
+        else if(r == WFQ_VALUE && VOLATILE_CAS(WFQ_CELL(q, i).deq, WFQ_BOT, WFQ_TOP) == WFQ_BOT)
+            items[k++] = item;
+    }
+    *done = k;
+    if(k > 0)
+        wfq_help_next_deq(q, h);
+    wfq_unpin(q, seg);
+    return k == n ? QUEUE_OK : k == take ? QUEUE_EMPTY : status;
+}
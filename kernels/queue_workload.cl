@@ -0,0 +1,131 @@
+#include "barrier.h"
+
+// Table-driven workload kernel. The host compiles workloads/*.wl into a
+// table of uint32_t words (main.cpp, compileWorkloads):
+//   [0] WORKLOAD_MAGIC  [1] workload count  [2 + w] offset of workload w
+//   workload: phase count, then WORKLOAD_PHASE_WORDS words per phase
+//   phase: {producer %, consumer %, ops per thread, ops per consumer,
+//           work per item, gap before the phase, repeat, flags}
+// Threads are ranked by tid * 100 / total_threads: ranks below producer %
+// enqueue, the next consumer % dequeue and the rest alternate between both.
+// Op counts flagged *_SCALED are a percentage of total_operations /
+// total_threads, as the fixed test kernels size their loops.
+// metrics[tid] gets the completed operations, metrics[total_threads + tid]
+// the ones given up after FAILSAFE, which the host reports as a failed run.
+#define WORKLOAD_MAGIC 0x574B4C31
+#define WORKLOAD_PHASE_WORDS 8
+#define WORKLOAD_SYNC 1         // PHASE_SYNC after the phase (grid-wide with -DGRID_BARRIER)
+#define WORKLOAD_BLOCKING 2     // dequeues retry until they get an item, not only while contended
+#define WORKLOAD_OPS_SCALED 4
+#define WORKLOAD_CONSUMER_OPS_SCALED 8
+
+inline uint32_t workload_ops(uint32_t value, uint32_t scaled, int total_operations, uint32_t total_threads){
+    return scaled ? (uint32_t)(((ulong)value * total_operations) / (100UL * total_threads)) : value;
+}
+
+inline void workload_spin(uint32_t seed, uint32_t amount){
+    volatile uint32_t work = seed;
+    for(uint32_t w = 0; w < amount; w++) work *= (w + 1);
+}
+
+// pattern_type selects the workload in the table
+kernel void workload_test(__global volatile barrier_t* b,
+                          __global volatile void* q,
+                          __global volatile uint32_t* metrics,
+                          __global volatile uint64_t* timing_data,
+                          int pattern_type,
+                          int total_operations,
+                          __global const uint32_t* table)
+{
+    TELEMETRY_INIT(timing_data)
+    TRACE_INIT(timing_data)
+    const unsigned int tid = get_global_id(0);
+    const unsigned int total_threads = get_global_size(0);
+    volatile __local unsigned int group;
+    volatile __local unsigned int groups;
+
+    TRACE_BARRIER_ENTER();
+    full_init(b, &group, &groups, tid, total_operations);
+    SYNCTHREADS;
+    TRACE_BARRIER_EXIT();
+    GRID_INIT(b)
+    // as in burst_pattern_test, non-occupant groups sit the phases out
+    const unsigned int ptid = GRID_TID;
+    const unsigned int pthreads = GRID_THREADS;
+
+    volatile uint32_t item;
+    uint32_t ops_completed = 0;
+    uint32_t ops_failed = 0;
+
+    if(GRID_OCCUPANT && table[0] == WORKLOAD_MAGIC && (uint32_t)pattern_type < table[1]){
+        __global const uint32_t* workload = table + table[2 + pattern_type];
+        const uint32_t phases = workload[0];
+        const uint32_t rank = (ptid * 100) / pthreads;
+        uint32_t step = 0;
+
+        for(uint32_t p = 0; p < phases; p++){
+            __global const uint32_t* phase = workload + 1 + p * WORKLOAD_PHASE_WORDS;
+            const uint32_t producers = phase[0];
+            const uint32_t consumers = phase[1];
+            const uint32_t work = phase[4];
+            const uint32_t gap = phase[5];
+            const uint32_t repeat = phase[6];
+            const uint32_t flags = phase[7];
+            const uint32_t ops = (rank >= producers && rank < producers + consumers)
+                ? workload_ops(phase[3], flags & WORKLOAD_CONSUMER_OPS_SCALED, total_operations, pthreads)
+                : workload_ops(phase[2], flags & WORKLOAD_OPS_SCALED, total_operations, pthreads);
+
+            for(uint32_t r = 0; r < repeat; r++, step++){
+                TRACE_PHASE(step);
+                workload_spin(ptid, gap);
+                for(uint32_t i = 0; i < ops; i++){
+                    const int produce = rank < producers ? 1
+                                      : rank < producers + consumers ? 0
+                                      : (i % 2 == 0);
+                    if(produce){
+                        // retry while contended; a full queue gets room by
+                        // this work-item dequeuing and processing an item,
+                        // and FAILSAFE ends the wait if none comes back
+                        int result;
+                        uint32_t fail = 0;
+                        TRACE_EVENT(TRACE_OP_BEGIN_EV, 0);
+                        do{
+                            result = try_enqueue(q, ptid * 1000 + i + 1);
+                            if(result == QUEUE_FULL && try_dequeue(q, &item) == QUEUE_OK){
+                                workload_spin(item, work);
+                                ops_completed++;
+                                TELEMETRY_OP(q);
+                            }
+                            if(result){ TELEMETRY_RETRY(); fail++; }
+                        }while(result && TEST_FAILSAFE);
+                        TRACE_EVENT(TRACE_OP_END_EV, fail);
+                        if(result){ ops_failed++; continue; }
+                    }else{
+                        // the host rejects specs whose blocking dequeues
+                        // starve; FAILSAFE still bounds the wait
+                        int result;
+                        uint32_t fail = 0;
+                        do{
+                            result = try_dequeue(q, &item);
+                            if(result){ TELEMETRY_RETRY(); fail++; }
+                        }while((result == QUEUE_CONTENDED || (result && (flags & WORKLOAD_BLOCKING))) && TEST_FAILSAFE);
+                        if(result){
+                            // a non-blocking dequeue may find the queue empty;
+                            // anything else here ran out of FAILSAFE
+                            if(result == QUEUE_CONTENDED || (flags & WORKLOAD_BLOCKING)) ops_failed++;
+                            continue;
+                        }
+                        workload_spin(item, work);
+                    }
+                    ops_completed++;
+                    TELEMETRY_OP(q);
+                }
+                if(flags & WORKLOAD_SYNC) PHASE_SYNC;
+            }
+        }
+    }
+
+    TELEMETRY_FLUSH(q);
+    metrics[tid] = ops_completed;
+    metrics[total_threads + tid] = ops_failed;
+}
@@ -0,0 +1,107 @@
+//live telemetry for the throughput kernels, enabled with -DTELEMETRY
+//the kernel's timing_data buffer becomes a ring the host polls while the
+//kernel runs:
+//  [0] samples written so far   [1] capacity in samples (set by the host)
+//  [2..3] reserved
+//  then capacity samples of TELEMETRY_SAMPLE_WORDS words:
+//  {seq+1 (written last), group, queue depth (int), group ops, group retries,
+//   seq+1 (written first), 0, 0}
+//the host copies the ring while the kernel runs and only keeps samples
+//whose two stamps agree
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#define TELEMETRY_HEADER_WORDS 4
+#define TELEMETRY_SAMPLE_WORDS 8
+
+#ifdef TELEMETRY
+
+//ops a work-item completes between two updates of its group's counters
+#ifndef TELEMETRY_PERIOD
+#define TELEMETRY_PERIOD 16
+#endif
+
+//approximate number of items in the queue
+#if defined(USE_SFQ_QUEUE)
+//slot API: tail is the enqueue ticket, head the dequeue ticket; negative
+//(as int) when consumers hold tickets ahead of the producers
+inline uint32_t sfq_depth(__global volatile my_queue_t * q){
+    return VREAD(q->tail) - VREAD(q->head);
+}
+#define TELEMETRY_DEPTH(Q) sfq_depth((__global volatile my_queue_t*)(Q))
+#elif defined(USE_MS_QUEUE)
+//one successful tail swing per enqueue and one head swing per dequeue,
+//so the difference of the ABA tags is the number of queued nodes
+inline uint32_t ms_depth(__global volatile ms_queue_t * q){
+    ms_pointer_t head, tail;
+    head.con = MS_READ(q->head.con);
+    tail.con = MS_READ(q->tail.con);
+    return (ms_index_t)(tail.sep.count - head.sep.count);
+}
+#define TELEMETRY_DEPTH(Q) ms_depth((__global volatile ms_queue_t*)(Q))
+#elif defined(USE_TZ_QUEUE)
+inline uint32_t tz_depth(__global volatile tz_queue_t * t){
+    return TZ_DIST(VREAD(t->head), VREAD(t->tail));
+}
+#define TELEMETRY_DEPTH(Q) tz_depth((__global volatile tz_queue_t*)(Q))
+#elif defined(USE_WFQ_QUEUE)
+//tickets handed out, including cells poisoned by early dequeuers
+inline uint32_t wfq_depth(__global volatile wfq_queue_t * q){
+    return VREAD(q->tail) - VREAD(q->head);
+}
+#define TELEMETRY_DEPTH(Q) wfq_depth((__global volatile wfq_queue_t*)(Q))
+#else
+#define TELEMETRY_DEPTH(Q) 0
+#endif
+
+inline void telemetry_emit(__global volatile uint32_t * ring, uint32_t depth, uint32_t ops, uint32_t retries){
+    const uint32_t capacity = ring[1];
+    if(capacity == 0) return;
+    const uint32_t seq = VOLATILE_INC(ring[0]);
+    __global volatile uint32_t * s = ring + TELEMETRY_HEADER_WORDS + (seq % capacity) * TELEMETRY_SAMPLE_WORDS;
+    VOLATILE_WRITE(s[5], seq + 1);
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    s[1] = get_group_id(0);
+    s[2] = depth;
+    s[3] = ops;
+    s[4] = retries;
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    VOLATILE_WRITE(s[0], seq + 1);
+}
+
+//must be the first statement of the kernel (declares __local counters)
+#define TELEMETRY_INIT(BUF) \
+    __global volatile uint32_t * tel_ring = (__global volatile uint32_t *)(BUF); \
+    volatile __local uint32_t tel_ops; \
+    volatile __local uint32_t tel_retries; \
+    uint32_t tel_count = 0; \
+    if(get_local_id(0) == 0){ tel_ops = 0; tel_retries = 0; }
+
+//after every completed operation; the group leader emits a sample
+#define TELEMETRY_OP(Q) do{ \
+    if(++tel_count % TELEMETRY_PERIOD == 0){ \
+        atomic_add(&tel_ops, TELEMETRY_PERIOD); \
+        if(get_local_id(0) == 0) \
+            telemetry_emit(tel_ring, TELEMETRY_DEPTH(Q), tel_ops, tel_retries); \
+    } }while(0)
+
+//inside the retry loops: one failed attempt of a queue operation
+#define TELEMETRY_RETRY() atomic_inc(&tel_retries)
+
+//last sample of the group once every work-item is done
+#define TELEMETRY_FLUSH(Q) do{ \
+    atomic_add(&tel_ops, tel_count % TELEMETRY_PERIOD); \
+    SYNCTHREADS; \
+    if(get_local_id(0) == 0) \
+        telemetry_emit(tel_ring, TELEMETRY_DEPTH(Q), tel_ops, tel_retries); \
+    }while(0)
+
+#else //TELEMETRY
+
+#define TELEMETRY_INIT(BUF)
+#define TELEMETRY_OP(Q) do{}while(0)
+#define TELEMETRY_RETRY()
+#define TELEMETRY_FLUSH(Q) do{}while(0)
+
+#endif //TELEMETRY
+#endif
@@ -0,0 +1,82 @@
+//per work-group event trace for the throughput kernels, enabled with -DTRACE
+//events go to a ring inside the timing_data buffer, after the telemetry
+//samples (see telemetry.h): header word [2] is the ring offset in words,
+//[3] its capacity in events, 0 disables tracing. Each event is
+//  {seq+1 (written last), group, kind << 24 | arg, device time}
+//seq comes from one global counter and is the logical clock; the time word
+//is the low 32 bits of the NVIDIA global timer (ns) with TRACE_GLOBALTIMER
+//and 0 otherwise. Only the group leader (local id 0) records events.
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#define TRACE_EVENT_WORDS 4
+
+#define TRACE_OP_BEGIN_EV 1
+#define TRACE_OP_END_EV 2       //arg: retries of the operation
+#define TRACE_PHASE_EV 3        //arg: phase number
+#define TRACE_BARRIER_ENTER_EV 4
+#define TRACE_BARRIER_EXIT_EV 5
+
+#ifdef TRACE
+
+#if defined(TRACE_GLOBALTIMER) && defined(NVIDIA)
+inline uint32_t trace_clock(){
+    ulong t;
+    asm volatile("mov.u64 %0, %%globaltimer;" : "=l"(t));
+    return (uint32_t)t;
+}
+#else
+#define trace_clock() 0
+#endif
+
+inline void trace_emit(__global volatile uint32_t * ring, uint32_t kind, uint32_t arg){
+    const uint32_t offset = ring[2];
+    const uint32_t capacity = ring[3];
+    if(offset == 0 || capacity == 0) return;
+    const uint32_t seq = VOLATILE_INC(ring[offset]);
+    __global volatile uint32_t * e = ring + offset + TRACE_EVENT_WORDS * (1 + seq % capacity);
+    e[1] = get_group_id(0);
+    e[2] = (kind << 24) | (arg & 0xFFFFFF);
+    e[3] = trace_clock();
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    VOLATILE_WRITE(e[0], seq + 1);
+}
+
+//must be the first statement of the kernel
+#define TRACE_INIT(BUF) \
+    __global volatile uint32_t * trace_ring = (__global volatile uint32_t *)(BUF);
+
+#define TRACE_EVENT(KIND, ARG) do{ \
+    if(get_local_id(0) == 0) trace_emit(trace_ring, KIND, ARG); }while(0)
+#define TRACE_PHASE(P) TRACE_EVENT(TRACE_PHASE_EV, P)
+#define TRACE_BARRIER_ENTER() TRACE_EVENT(TRACE_BARRIER_ENTER_EV, 0)
+#define TRACE_BARRIER_EXIT() TRACE_EVENT(TRACE_BARRIER_EXIT_EV, 0)
+
+#else //TRACE
+
+#define TRACE_INIT(BUF)
+#define TRACE_EVENT(KIND, ARG) do{}while(0)
+#define TRACE_PHASE(P) do{}while(0)
+#define TRACE_BARRIER_ENTER() do{}while(0)
+#define TRACE_BARRIER_EXIT() do{}while(0)
+
+#endif //TRACE
+
+//retry a try_* call (queue_try.h) until it returns QUEUE_OK or FAILSAFE
+//attempts failed, counting the failed attempts for telemetry and tracing the
+//attempt as one operation; RESULT gets the last status
+#define QUEUE_RETRY(RESULT, OP) do{ \
+    uint32_t fail = 0; \
+    TRACE_EVENT(TRACE_OP_BEGIN_EV, 0); \
+    while(((RESULT) = (OP)) != QUEUE_OK && (TEST_FAILSAFE)){ TELEMETRY_RETRY(); fail++; } \
+    TRACE_EVENT(TRACE_OP_END_EV, fail); \
+    }while(0)
+
+//one non-blocking attempt: retry only while CONTENDED, so RESULT ends as
+//QUEUE_OK or the QUEUE_FULL/QUEUE_EMPTY that stopped it
+#define QUEUE_ATTEMPT(RESULT, OP) do{ \
+    uint32_t fail = 0; \
+    while(((RESULT) = (OP)) == QUEUE_CONTENDED && (TEST_FAILSAFE)){ TELEMETRY_RETRY(); fail++; } \
+    }while(0)
+
+#endif
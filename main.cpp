@@ -2,15 +2,26 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <vector>
 #include <string>
+#include <map>
+#include <tuple>
+#include <cmath>
+#include <thread>
+#include <random>
 #include <chrono>
 #include <algorithm>
 #include <climits>
+#include <cctype>
+#include <functional>
+#include <atomic>
+#include <mutex>
 
 #define __CL_ENABLE_EXTENSIONS
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
-#define CL_TARGET_OPENCL_VERSION 120
+#define CL_TARGET_OPENCL_VERSION 200
 #if defined(__APPLE__) || defined(__MACOSX)
 #include <OpenCL/opencl.h>
 #else
@@ -29,15 +40,156 @@ struct ms_node_t {
     unsigned int free;
 };
 
-struct ms_queue_layout {
-    ms_pointer_t head;
-    ms_pointer_t tail;
-    ms_node_t nodes[4097]; // MY_QUEUE_LENGTH + 1
+// MS_WIDE: 32-bit count and index in one 8-byte aligned word, so the node
+// is value, padding, next, free, padding (24 bytes) like the OpenCL struct
+struct alignas(8) ms_wide_pointer_t {
+    uint32_t count;
+    uint32_t ptr;
+};
+
+struct ms_wide_node_t {
+    unsigned value;
+    ms_wide_pointer_t next;
+    unsigned int free;
+};
+
+// Largest MY_QUEUE_LENGTH the 16-bit ms_pointer_t can index
+const unsigned MS_NARROW_MAX_LENGTH = 65535;
+
+// wfq_queue_t in kernels/queue_wfq.cl: tail, head, low, one word per ring
+// segment, eight handle arrays of WFQ_HANDLES words, then WFQ_LAPS segments
+// of MY_QUEUE_LENGTH cells of three words
+const unsigned WFQ_HANDLES = 1024;
+const unsigned WFQ_HANDLE_ARRAYS = 8;
+const unsigned WFQ_LAPS = 16;
+const unsigned WFQ_CELL_WORDS = 3;
+
+// total_operations argument and thread counts of the throughput sweep
+const int SWEEP_OPERATIONS = 1000;
+const std::vector<int> SWEEP_THREAD_COUNTS = {64, 128, 256, 512};
+
+// ms_queue_t is head, tail, nodes[MY_QUEUE_LENGTH + 1], then this trailer
+struct ms_queue_trailer {
     unsigned hazard1[1500];
     unsigned hazard2[1500];
     unsigned base_spin;
 };
 
+// Compile-time knobs of the queue kernels plus the launch geometry;
+// this is the space the autotuner searches
+struct TuneConfig {
+    unsigned queue_length;  // MY_QUEUE_LENGTH (power of two, MY_QUEUE_FACTOR derived)
+    unsigned groups;        // GROUPS
+    unsigned work;          // WORK - spin/backoff iterations
+    unsigned failsafe;      // FAILSAFE - retries before SFQ gives up on a slot
+    size_t local_size;      // work-group size, clamped to the thread count
+};
+
+// Build-time variant of the queue kernels and host buffer layout, resolved per device
+struct QueueLayout {
+    std::string sfq_layout = "split";  // split, aos, padded (SFQ_LAYOUT)
+    unsigned sfq_swizzle = 16;         // SFQ_SWIZZLE, 1 = no swizzle
+    unsigned sfq_line_words = 16;      // SFQ_LINE_WORDS, cache line in 4-byte words
+    unsigned tz_scan_width = 1;        // TZ_SCAN_WIDTH, cells per tail/head scan step
+    bool cl2_atomics = false;          // USE_CL2_ATOMICS, OpenCL 2.0 acquire/release atomics
+    bool ms_wide = false;              // MS_WIDE, 64-bit MS pointers with 32-bit index and tag
+    bool telemetry = false;            // TELEMETRY, live samples in the timing_data ring
+    bool trace = false;                // TRACE, per work-group event ring after the samples
+    bool grid_barrier = false;         // GRID_BARRIER, grid-wide phases over the co-resident groups
+};
+
+// One phase of a workload spec (workloads/*.wl), the WORKLOAD_PHASE_WORDS
+// words of the device table in kernels/queue_workload.cl
+struct WorkloadPhase {
+    uint32_t producers = 50;    // % of threads that only enqueue
+    uint32_t consumers = 50;    // % of threads that only dequeue, the rest alternate
+    uint32_t ops = 1;           // operations per thread (WORKLOAD_OPS_SCALED: % of total_operations / threads)
+    uint32_t consumer_ops = 1;  // operations per consumer thread (WORKLOAD_CONSUMER_OPS_SCALED: same)
+    uint32_t work = 0;          // spin iterations per dequeued item
+    uint32_t gap = 0;           // spin iterations before the phase
+    uint32_t repeat = 1;
+    uint32_t flags = 0;         // WORKLOAD_SYNC | WORKLOAD_BLOCKING | WORKLOAD_*_SCALED
+};
+
+struct Workload {
+    std::string name;
+    std::vector<WorkloadPhase> phases;
+};
+
+// Command line options shared by every device session
+struct RunOptions {
+    bool autotune = false;
+    int tune_budget = 64;       // kernel launches per (test, pattern)
+    int tune_threads = 512;
+    bool use_profile = true;
+    std::string profile_path;   // empty = queue_tuning_<device>.profile
+    std::string sfq_layout = "split";
+    int sfq_swizzle = 16;       // 0 = device cache line, 1 = no swizzle
+    int sfq_line_words = 0;     // 0 = device cache line
+    int tz_scan_width = 1;      // 1, 4 or 8
+    bool pipeline = true;       // overlap sweep setup with the running kernel
+    int cl2_atomics = 0;        // 0 = off (OpenCL 1.2 macros), 1 = on, -1 = when the device has OpenCL C 2.0
+    bool ms_wide = false;
+    bool grid_barrier = false;  // grid-wide phase barriers in burst_pattern_test/workload_test
+    unsigned queue_length = 0;  // 0 = built-in default / tuned profile
+    std::string telemetry;      // empty = off, else CSV prefix (<prefix>_<device>.csv)
+    unsigned telemetry_samples = 4096;  // ring capacity in samples
+    std::string trace;          // empty = off, else Chrome trace prefix (<prefix>_<device>.json)
+    unsigned trace_events = 65536;  // trace ring capacity in events
+    bool trace_timer = false;   // NVIDIA %globaltimer timestamps instead of the logical clock
+    std::vector<Workload> workloads;  // --workload specs, run by workload_test after the sweep
+    std::vector<int> copy_chunks = {64, 256, 1024, 4096};  // bulk copy chunk sizes in ints, empty = skip
+    unsigned copy_elements = 1 << 20;                      // ints copied per bulk copy run
+};
+
+// One throughput measurement, tagged with the device it ran on
+struct ThroughputResult {
+    std::string device;
+    std::string queue_type;
+    std::string test_name;
+    std::string variant;    // queue layout/build variant, empty for the default
+    int threads;
+    int active_threads;     // work-items that did the work (grid barrier occupants), else threads
+    int pattern;
+    uint32_t ops;
+    long long time_us;
+    double throughput;
+};
+
+// One verified bulk copy run (runCopyBenchmark)
+struct CopyResult {
+    std::string device;
+    std::string queue_type;
+    std::string variant;
+    int chunk;              // ints per chunk
+    size_t work_items;      // global size of the launch
+    uint32_t chunks;
+    long long time_us;
+    double chunks_per_sec;
+    double ints_per_sec;
+    double gbps;            // bytes read plus bytes written
+};
+
+// Per-device OpenCL state; each device gets its own context and command queue
+struct DeviceSession {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue command_queue;
+    cl_command_queue pipeline_queue;  // out-of-order + profiling, used by the pipelined sweep
+    std::string label;
+    std::string vendor;
+    QueueLayout layout;
+    std::string telemetry_path;       // CSV the sweep appends telemetry to
+    bool telemetry_svm = false;       // sample ring in fine-grained SVM (cl2 builds), else mapped host memory
+    unsigned telemetry_samples = 0;
+    std::string trace_path;           // Chrome trace (JSON array format) the sweep appends to
+    unsigned trace_events = 0;
+    bool trace_timer = false;
+    unsigned trace_runs = 0;          // trace pid of the next run
+    std::vector<Workload> workloads;  // the --workload specs compiled into workload_table
+    cl_mem workload_table = NULL;     // compiled --workload specs, argument 6 of workload_test
+};
+
 std::string getGPUName(cl_device_id device) {
     char device_name[256];
     clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
@@ -46,213 +198,1608 @@ std::string getGPUName(cl_device_id device) {
     return name;
 }
 
+// Session label (device name, or "index:name" with several devices) as a
+// file name part, so devices of the same model write separate files
+std::string sessionFileTag(const std::string& label) {
+    std::string tag = label;
+    std::replace(tag.begin(), tag.end(), ':', '_');
+    return tag;
+}
+
 std::string getVendorName(cl_device_id device) {
     char vendor[256];
     clGetDeviceInfo(device, CL_DEVICE_VENDOR, sizeof(vendor), vendor, NULL);
     return std::string(vendor);
 }
 
-// Forward declaration
-void runThroughputTest(cl_context context, cl_command_queue command_queue, cl_program program, 
-                      const std::string& queue_type, size_t queue_size, cl_device_id device);
+std::string getDeviceTypeName(cl_device_id device) {
+    cl_device_type type = 0;
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+    if (type & CL_DEVICE_TYPE_GPU) return "GPU";
+    if (type & CL_DEVICE_TYPE_CPU) return "CPU";
+    if (type & CL_DEVICE_TYPE_ACCELERATOR) return "ACCELERATOR";
+    return "OTHER";
+}
+
+// Forward declarations
+void printAggregatedReport(const std::vector<std::string>& device_labels,
+                           const std::vector<ThroughputResult>& results,
+                           const std::vector<CopyResult>& copies);
+
+// Collect devices of the given type from every platform
+std::vector<cl_device_id> enumerateDevices(cl_device_type type) {
+    std::vector<cl_device_id> found;
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <queue_type>" << std::endl;
-        std::cout << "queue_type: sfq, ms, tz" << std::endl;
-        return 1;
-    }
-    
-    std::string queue_type = argv[1];
-    if (queue_type != "sfq" && queue_type != "ms" && queue_type != "tz") {
-        std::cerr << "Error: queue_type must be sfq, ms, or tz" << std::endl;
-        return 1;
-    }
-    
-    cl_int err;
-    
-    // Get GPU device
     cl_uint num_platforms;
-    err = clGetPlatformIDs(0, NULL, &num_platforms);
+    cl_int err = clGetPlatformIDs(0, NULL, &num_platforms);
     if (err != CL_SUCCESS || num_platforms == 0) {
-        std::cerr << "No OpenCL platforms found!" << std::endl;
-        return 1;
+        return found;
     }
-    
+
     std::vector<cl_platform_id> platforms(num_platforms);
     clGetPlatformIDs(num_platforms, platforms.data(), NULL);
-    
-    cl_device_id gpu_device = NULL;
+
     for (cl_platform_id platform : platforms) {
         cl_uint num_devices;
-        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &num_devices);
+        err = clGetDeviceIDs(platform, type, 0, NULL, &num_devices);
         if (err == CL_SUCCESS && num_devices > 0) {
             std::vector<cl_device_id> devices(num_devices);
-            clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, num_devices, devices.data(), NULL);
-            gpu_device = devices[0];
-            break;
+            clGetDeviceIDs(platform, type, num_devices, devices.data(), NULL);
+            found.insert(found.end(), devices.begin(), devices.end());
         }
     }
-    
-    if (gpu_device == NULL) {
-        std::cerr << "No GPU devices found!" << std::endl;
-        return 1;
+    return found;
+}
+
+unsigned queueFactor(unsigned queue_length) {
+    unsigned factor = 0;
+    while ((1u << factor) < queue_length) factor++;
+    return factor;
+}
+
+TuneConfig defaultTuneConfig(const std::string& vendor) {
+    TuneConfig config;
+    config.queue_length = 4096;
+    config.groups = 256;
+    config.work = 100;
+    // Vendor-specific builds use a reasonable failsafe, everything else keeps the barrier.h default
+    bool known_vendor = vendor.find("AMD") != std::string::npos ||
+                        vendor.find("NVIDIA") != std::string::npos ||
+                        vendor.find("Intel") != std::string::npos;
+    config.failsafe = known_vendor ? 1000 : 10000;
+    config.local_size = 256;
+    return config;
+}
+
+std::string makeBuildOptions(const std::string& queue_type, const DeviceSession& session, const TuneConfig& config) {
+    const std::string& vendor = session.vendor;
+
+    // Build options
+    std::ostringstream opts;
+    opts << "-I./kernels -DMY_QUEUE_LENGTH=" << config.queue_length
+         << " -DMY_QUEUE_FACTOR=" << queueFactor(config.queue_length)
+         << " -DGROUPS=" << config.groups
+         << " -DWORK=" << config.work;
+    std::string buildOpts = opts.str();
+    if (session.layout.cl2_atomics) {
+        buildOpts += " -cl-std=CL2.0 -DUSE_CL2_ATOMICS";
     }
-    
-    std::string gpu_name = getGPUName(gpu_device);
-    std::string vendor = getVendorName(gpu_device);
-    std::cout << "Using GPU: " << gpu_name << std::endl;
-    std::cout << "Testing " << queue_type << " queue..." << std::endl;
-    
+    if (session.layout.grid_barrier) {
+        buildOpts += " -DGRID_BARRIER";
+    }
+    if (session.layout.telemetry) {
+        buildOpts += " -DTELEMETRY";
+    }
+    if (session.layout.trace) {
+        buildOpts += " -DTRACE";
+        if (session.trace_timer) {
+            buildOpts += " -DTRACE_GLOBALTIMER";
+        }
+    }
+
+    // Queue-specific defines
+    if (queue_type == "sfq") {
+        buildOpts += " -DUSE_SFQ_QUEUE";
+        const QueueLayout& layout = session.layout;
+        if (layout.sfq_layout == "aos") {
+            buildOpts += " -DSFQ_LAYOUT=1";
+        } else if (layout.sfq_layout == "padded") {
+            buildOpts += " -DSFQ_LAYOUT=2";
+        }
+        buildOpts += " -DSFQ_LINE_WORDS=" + std::to_string(layout.sfq_line_words);
+        buildOpts += " -DSFQ_SWIZZLE=" + std::to_string(std::min(layout.sfq_swizzle, config.queue_length));
+    } else if (queue_type == "ms") {
+        buildOpts += " -DUSE_MS_QUEUE";
+        if (session.layout.ms_wide) {
+            buildOpts += " -DMS_WIDE";
+        }
+    } else if (queue_type == "tz") {
+        buildOpts += " -DUSE_TZ_QUEUE";
+        buildOpts += " -DTZ_SCAN_WIDTH=" + std::to_string(session.layout.tz_scan_width);
+    } else if (queue_type == "wfq") {
+        buildOpts += " -DUSE_WFQ_QUEUE";
+    }
+
+    // Vendor-specific optimizations
+    if (vendor.find("AMD") != std::string::npos) {
+        buildOpts += " -DAMD -DWARP=64";
+    } else if (vendor.find("NVIDIA") != std::string::npos) {
+        buildOpts += " -DNVIDIA -DWARP=32";
+    } else if (vendor.find("Intel") != std::string::npos) {
+        buildOpts += " -DINTEL -DWARP=16";
+    }
+    buildOpts += " -DFAILSAFE=" + std::to_string(config.failsafe);
+
+    return buildOpts;
+}
+
+// Short name of the layout variant, reported next to the results
+std::string queueVariantName(const std::string& queue_type, const QueueLayout& layout) {
+    std::string name;
+    if (queue_type == "sfq") {
+        std::string swizzle = layout.sfq_swizzle > 1 ? "swizzle" + std::to_string(layout.sfq_swizzle) : "noswizzle";
+        name = layout.sfq_layout + "/" + swizzle;
+    } else if (queue_type == "ms" && layout.ms_wide) {
+        name = "wide";
+    } else if (queue_type == "tz" && layout.tz_scan_width > 1) {
+        name = "scan" + std::to_string(layout.tz_scan_width);
+    }
+    if (layout.cl2_atomics) {
+        name += name.empty() ? "cl2" : "/cl2";
+    }
+    if (layout.grid_barrier) {
+        name += name.empty() ? "grid" : "/grid";
+    }
+    return name;
+}
+
+// OpenCL C version of the device as major*100 + minor*10, e.g. 120 or 200
+int getOpenCLCVersion(cl_device_id device) {
+    char version[256] = {0};
+    clGetDeviceInfo(device, CL_DEVICE_OPENCL_C_VERSION, sizeof(version), version, NULL);
+    int major = 0, minor = 0;
+    if (sscanf(version, "OpenCL C %d.%d", &major, &minor) != 2) {
+        return 0;
+    }
+    return major * 100 + minor * 10;
+}
+
+size_t queueSizeBytes(const std::string& queue_type, unsigned queue_length, const QueueLayout& layout) {
+    if (queue_type == "ms") {
+        if (layout.ms_wide) {
+            // the OpenCL struct is padded to the 8-byte alignment of its pointers
+            size_t bytes = 2 * sizeof(ms_wide_pointer_t) + (size_t)(queue_length + 1) * sizeof(ms_wide_node_t)
+                         + sizeof(ms_queue_trailer);
+            return (bytes + 7) & ~(size_t)7;
+        }
+        return 2 * sizeof(ms_pointer_t) + (queue_length + 1) * sizeof(ms_node_t) + sizeof(ms_queue_trailer);
+    } else if (queue_type == "sfq") {
+        if (layout.sfq_layout == "padded") {
+            // head, tail and {vnull, done} lines, then one line per cell
+            return (size_t)(3 + queue_length) * layout.sfq_line_words * sizeof(uint32_t);
+        }
+        return queue_length * 3 * sizeof(uint32_t);
+    } else if (queue_type == "tz") {
+        return (queue_length + 5) * sizeof(uint32_t);
+    } else if (queue_type == "wfq") {
+        return (3 + WFQ_LAPS + (size_t)WFQ_HANDLE_ARRAYS * WFQ_HANDLES
+                + (size_t)queue_length * WFQ_LAPS * WFQ_CELL_WORDS) * sizeof(uint32_t);
+    }
+    return 0;
+}
+
+// Head and tail on the dummy node 1, every other node free, hazards cleared
+template <typename Pointer, typename Node>
+void initMsQueue(std::vector<uint32_t>& init_data, unsigned queue_length) {
+    Pointer* ends = reinterpret_cast<Pointer*>(init_data.data());
+    Node* nodes = reinterpret_cast<Node*>(ends + 2);
+    ms_queue_trailer* trailer = reinterpret_cast<ms_queue_trailer*>(nodes + queue_length + 1);
+
+    // Initialize head and tail to point to dummy node (node 1)
+    ends[0].ptr = 1;
+    ends[0].count = 0;
+    ends[1].ptr = 1;
+    ends[1].count = 0;
+
+    // Initialize nodes
+    for (unsigned i = 0; i < queue_length + 1; i++) {
+        if (i == 1) {
+            nodes[i].free = 1; // FREE_FALSE - dummy node is occupied
+        } else {
+            nodes[i].free = 0; // FREE_TRUE - available
+        }
+        nodes[i].value = 0;
+        nodes[i].next.ptr = 0;
+        nodes[i].next.count = 0;
+    }
+
+    // Initialize hazard arrays to UINT_MAX
+    for (int i = 0; i < 1500; i++) {
+        trailer->hazard1[i] = UINT_MAX;
+        trailer->hazard2[i] = UINT_MAX;
+    }
+
+    trailer->base_spin = 0;
+}
+
+// Initial contents of the queue buffer for the selected queue type
+std::vector<uint32_t> queueInitData(const std::string& queue_type, unsigned queue_length, const QueueLayout& layout) {
+    std::vector<uint32_t> init_data;
+    if (queue_type == "sfq") {
+        init_data.assign(queueSizeBytes(queue_type, queue_length, layout) / sizeof(uint32_t), 0);
+    } else if (queue_type == "ms") {
+        init_data.assign(queueSizeBytes(queue_type, queue_length, layout) / sizeof(uint32_t), 0);
+        if (layout.ms_wide) {
+            initMsQueue<ms_wide_pointer_t, ms_wide_node_t>(init_data, queue_length);
+        } else {
+            initMsQueue<ms_pointer_t, ms_node_t>(init_data, queue_length);
+        }
+    } else if (queue_type == "tz") {
+        init_data.assign(queue_length + 5, 0);
+        init_data[0] = 0;  // head
+        init_data[1] = 1;  // tail
+        init_data[2] = 4294967295;  // vnull
+        for (unsigned i = 3; i < queue_length + 5; i++) {
+            init_data[i] = 4294967294;  // null_0
+        }
+        init_data[3] = 4294967295;  // first to null_1
+    } else if (queue_type == "wfq") {
+        // empty cells, free handles and the ring's first lap, open and unpinned,
+        // are all zero
+        init_data.assign(queueSizeBytes(queue_type, queue_length, layout) / sizeof(uint32_t), 0);
+    }
+    return init_data;
+}
+
+// Write the initial state of the selected queue type into queue_buf
+void initQueueBuffer(cl_command_queue command_queue, cl_mem queue_buf, const std::string& queue_type,
+                     unsigned queue_length, const QueueLayout& layout) {
+    std::vector<uint32_t> init_data = queueInitData(queue_type, queue_length, layout);
+    if (!init_data.empty()) {
+        clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
+    }
+}
+
+cl_program buildQueueProgram(cl_context context, cl_device_id device, const std::string& src,
+                             const std::string& buildOpts, std::ostream& log) {
+    cl_int err;
+
+    // Create and build program
+    const char* src_ptr = src.c_str();
+    size_t src_size = src.length();
+    cl_program program = clCreateProgramWithSource(context, 1, &src_ptr, &src_size, &err);
+    if (err != CL_SUCCESS) {
+        log << "Failed to create program!" << std::endl;
+        return NULL;
+    }
+
+    err = clBuildProgram(program, 1, &device, buildOpts.c_str(), NULL, NULL);
+    if (err != CL_SUCCESS) {
+        log << "Build failed!" << std::endl;
+        size_t log_size;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        std::vector<char> build_log(log_size);
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), NULL);
+        log << "Build log: " << build_log.data() << std::endl;
+        clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+// Programs built for one device, keyed by their build options, so that tuned
+// configurations sharing the same defines are only compiled once
+struct ProgramCache {
+    cl_context context;
+    cl_device_id device;
+    std::string src;
+    std::map<std::string, cl_program> programs;
+
+    cl_program get(const std::string& buildOpts, std::ostream& log) {
+        auto it = programs.find(buildOpts);
+        if (it != programs.end()) {
+            return it->second;
+        }
+        cl_program program = buildQueueProgram(context, device, src, buildOpts, log);
+        if (program != NULL) {
+            programs[buildOpts] = program;
+        }
+        return program;
+    }
+
+    void release() {
+        for (auto& entry : programs) {
+            clReleaseProgram(entry.second);
+        }
+        programs.clear();
+    }
+};
+
+// Autotuning profile: best configuration per (queue type, build variant,
+// thread count, test, pattern). The variant is queueVariantName() and
+// covers the SFQ layout, MS width, TZ scan width, cl2 atomics and grid barrier.
+typedef std::tuple<std::string, std::string, int, std::string, int> ProfileKey;
+struct ProfileEntry {
+    TuneConfig config;
+    double throughput;
+};
+typedef std::map<ProfileKey, ProfileEntry> TuneProfile;
+
+// Devices of the same model share a profile file; sessions of a multi-device
+// run read and rewrite it under this lock
+std::mutex profile_mutex;
+
+ProfileKey profileKey(const std::string& queue_type, const std::string& variant, int threads,
+                      const std::string& test_name, int pattern) {
+    return ProfileKey(queue_type, variant.empty() ? "-" : variant, threads, test_name, pattern);
+}
+
+std::string profilePath(const RunOptions& options, cl_device_id device) {
+    if (!options.profile_path.empty()) {
+        return options.profile_path;
+    }
+    // device names carry spaces and sometimes '/'
+    std::string name = getGPUName(device);
+    for (char& c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '-') {
+            c = '_';
+        }
+    }
+    return "queue_tuning_" + name + ".profile";
+}
+
+// Lines of another format (e.g. without variant and thread count) are skipped
+bool readProfile(const std::string& path, TuneProfile& profile) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string queue_type, variant, test_name, extra;
+        int threads, pattern;
+        ProfileEntry entry;
+        if (fields >> queue_type >> variant >> threads >> test_name >> pattern
+                   >> entry.config.queue_length >> entry.config.groups >> entry.config.work
+                   >> entry.config.failsafe >> entry.config.local_size >> entry.throughput
+            && !(fields >> extra)) {
+            profile[ProfileKey(queue_type, variant, threads, test_name, pattern)] = entry;
+        }
+    }
+    return true;
+}
+
+bool loadProfile(const std::string& path, TuneProfile& profile) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    return readProfile(path, profile);
+}
+
+// Merges the entries into the file as it is now, so sessions sharing the
+// file keep each other's results, and replaces it in one rename
+bool saveProfile(const std::string& path, const std::string& device_name, const TuneProfile& profile) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    TuneProfile merged;
+    readProfile(path, merged);
+    for (const auto& entry : profile) {
+        merged[entry.first] = entry.second;
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path);
+        if (!out) {
+            return false;
+        }
+        out << "# queue autotuning profile for " << device_name << std::endl;
+        out << "# queue variant threads test pattern queue_length groups work failsafe local_size throughput" << std::endl;
+        for (const auto& entry : merged) {
+            const TuneConfig& c = entry.second.config;
+            out << std::get<0>(entry.first) << " " << std::get<1>(entry.first) << " " << std::get<2>(entry.first)
+                << " " << std::get<3>(entry.first) << " " << std::get<4>(entry.first)
+                << " " << c.queue_length << " " << c.groups << " " << c.work << " " << c.failsafe
+                << " " << c.local_size << " " << entry.second.throughput << std::endl;
+        }
+        if (!out) {
+            return false;
+        }
+    }
+    return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+// Table layout and phase flags shared with kernels/queue_workload.cl
+const uint32_t WORKLOAD_MAGIC = 0x574B4C31;
+const unsigned WORKLOAD_PHASE_WORDS = 8;
+const uint32_t WORKLOAD_SYNC = 1;
+const uint32_t WORKLOAD_BLOCKING = 2;
+const uint32_t WORKLOAD_OPS_SCALED = 4;
+const uint32_t WORKLOAD_CONSUMER_OPS_SCALED = 8;
+
+// Operations per thread of a phase, as workload_ops() in the kernel computes them
+uint32_t workloadOps(uint32_t value, bool scaled, int total_operations, int threads) {
+    return scaled ? (uint32_t)((uint64_t)value * total_operations / (100ull * threads)) : value;
+}
+
+// Items one repeat of a phase enqueues (supply) and dequeues (demand), with
+// threads ranked as in workload_test
+void workloadPhaseFlow(const WorkloadPhase& p, int threads, int total_operations,
+                       uint64_t& supply, uint64_t& demand) {
+    const uint32_t ops = workloadOps(p.ops, p.flags & WORKLOAD_OPS_SCALED, total_operations, threads);
+    const uint32_t consumer_ops = workloadOps(p.consumer_ops, p.flags & WORKLOAD_CONSUMER_OPS_SCALED,
+                                              total_operations, threads);
+    supply = demand = 0;
+    for (int tid = 0; tid < threads; tid++) {
+        const uint32_t rank = (uint32_t)tid * 100 / threads;
+        if (rank < p.producers) {
+            supply += ops;
+        } else if (rank < p.producers + p.consumers) {
+            demand += consumer_ops;
+        } else {
+            supply += (ops + 1) / 2;
+            demand += ops / 2;
+        }
+    }
+}
+
+// First phase (0-based, counting repeats) whose blocking dequeues ask for
+// more items than the earlier phases left in the queue plus what this one
+// produces, or -1. Non-blocking dequeues are assumed to take everything
+// they can.
+int workloadStarvedPhase(const Workload& workload, int threads, int total_operations) {
+    uint64_t available = 0;
+    int step = 0;
+    for (const WorkloadPhase& p : workload.phases) {
+        uint64_t supply, demand;
+        workloadPhaseFlow(p, threads, total_operations, supply, demand);
+        for (uint32_t r = 0; r < p.repeat; r++, step++) {
+            available += supply;
+            if ((p.flags & WORKLOAD_BLOCKING) && demand > available) {
+                return step;
+            }
+            available -= std::min(demand, available);
+        }
+    }
+    return -1;
+}
+
+// Append the workloads of a spec file:
+//   workload NAME
+//   phase producers=% consumers=% ops=N consumer_ops=N work=N gap=N repeat=N [sync] [blocking]
+// '#' starts a comment; consumer_ops defaults to ops. ops/consumer_ops are
+// absolute counts, or with a % suffix a share of total_operations / threads.
+// Workloads whose blocking dequeues would wait forever in one of the sweep's
+// launches are rejected.
+bool loadWorkloads(const std::string& path, std::vector<Workload>& workloads, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword)) {
+            continue;
+        }
+        const std::string where = path + ":" + std::to_string(line_number) + ": ";
+        if (keyword == "workload") {
+            Workload workload;
+            if (!(words >> workload.name)) {
+                error = where + "workload needs a name";
+                return false;
+            }
+            workloads.push_back(workload);
+        } else if (keyword == "phase") {
+            if (workloads.empty()) {
+                error = where + "phase before the first workload";
+                return false;
+            }
+            WorkloadPhase phase;
+            bool consumer_ops = false;
+            std::string field;
+            while (words >> field) {
+                size_t eq = field.find('=');
+                std::string key = field.substr(0, eq);
+                if (eq == std::string::npos) {
+                    if (key == "sync") {
+                        phase.flags |= WORKLOAD_SYNC;
+                    } else if (key == "blocking") {
+                        phase.flags |= WORKLOAD_BLOCKING;
+                    } else {
+                        error = where + "unknown flag " + key;
+                        return false;
+                    }
+                    continue;
+                }
+                char* end = NULL;
+                unsigned long value = strtoul(field.c_str() + eq + 1, &end, 10);
+                const bool scaled = *end == '%' && (key == "ops" || key == "consumer_ops");
+                if (eq + 1 == field.size() || *(scaled ? end + 1 : end) != '\0') {
+                    error = where + "bad value in " + field;
+                    return false;
+                }
+                if (key == "producers") phase.producers = value;
+                else if (key == "consumers") phase.consumers = value;
+                else if (key == "ops") {
+                    phase.ops = value;
+                    if (scaled) phase.flags |= WORKLOAD_OPS_SCALED;
+                }
+                else if (key == "consumer_ops") {
+                    phase.consumer_ops = value;
+                    consumer_ops = true;
+                    if (scaled) phase.flags |= WORKLOAD_CONSUMER_OPS_SCALED;
+                }
+                else if (key == "work") phase.work = value;
+                else if (key == "gap") phase.gap = value;
+                else if (key == "repeat") phase.repeat = value;
+                else {
+                    error = where + "unknown key " + key;
+                    return false;
+                }
+            }
+            if (!consumer_ops) {
+                phase.consumer_ops = phase.ops;
+                if (phase.flags & WORKLOAD_OPS_SCALED) phase.flags |= WORKLOAD_CONSUMER_OPS_SCALED;
+            }
+            if (phase.producers + phase.consumers > 100) {
+                error = where + "producers + consumers exceed 100%";
+                return false;
+            }
+            workloads.back().phases.push_back(phase);
+        } else {
+            error = where + "expected workload or phase, got " + keyword;
+            return false;
+        }
+    }
+    for (const Workload& workload : workloads) {
+        if (workload.phases.empty()) {
+            error = path + ": workload " + workload.name + " has no phases";
+            return false;
+        }
+        for (int threads : SWEEP_THREAD_COUNTS) {
+            int step = workloadStarvedPhase(workload, threads, SWEEP_OPERATIONS);
+            if (step >= 0) {
+                error = path + ": workload " + workload.name + ": blocking dequeues of phase step " +
+                        std::to_string(step) + " need more items than are produced (" +
+                        std::to_string(threads) + " threads)";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Flatten workloads into the device table read by workload_test
+std::vector<uint32_t> compileWorkloads(const std::vector<Workload>& workloads) {
+    std::vector<uint32_t> table = {WORKLOAD_MAGIC, (uint32_t)workloads.size()};
+    table.resize(2 + workloads.size());
+    for (size_t w = 0; w < workloads.size(); w++) {
+        table[2 + w] = table.size();
+        table.push_back(workloads[w].phases.size());
+        for (const WorkloadPhase& p : workloads[w].phases) {
+            uint32_t words[WORKLOAD_PHASE_WORDS] = {p.producers, p.consumers, p.ops, p.consumer_ops,
+                                                    p.work, p.gap, p.repeat, p.flags};
+            table.insert(table.end(), words, words + WORKLOAD_PHASE_WORDS);
+        }
+    }
+    return table;
+}
+
+// Ring layout shared with kernels/telemetry.h
+const unsigned TELEMETRY_HEADER_WORDS = 4;
+const unsigned TELEMETRY_SAMPLE_WORDS = 8;
+
+// One sample written by a work-group leader, stamped when the host saw it
+struct TelemetrySample {
+    double host_us;     // since kernel launch
+    uint32_t seq;
+    uint32_t group;
+    int32_t depth;      // queued items; negative for SFQ when consumers wait
+    uint32_t ops;       // ops completed by the group so far
+    uint32_t retries;   // failed queue attempts of the group so far
+};
+
+// Ring layout shared with kernels/trace.h; the trace ring follows the
+// telemetry samples and starts with a one-event cursor slot
+const unsigned TRACE_EVENT_WORDS = 4;
+
+// One event of a work-group leader
+struct TraceEvent {
+    uint32_t seq;       // logical clock
+    uint32_t group;
+    uint32_t kind;      // TRACE_*_EV in kernels/trace.h
+    uint32_t arg;       // retries for op end, phase number for phases
+    uint32_t time;      // device timer (ns, low 32 bits) or 0
+};
+
+enum TraceKind { TRACE_OP_BEGIN = 1, TRACE_OP_END, TRACE_PHASE, TRACE_BARRIER_ENTER, TRACE_BARRIER_EXIT };
+
+// What a TELEMETRY/TRACE build recorded during one run
+struct RunCapture {
+    std::vector<TelemetrySample> telemetry;
+    std::vector<TraceEvent> trace;
+};
+
+// Word offsets and total size of the timing_data buffer
+struct TimingLayout {
+    unsigned telemetry_samples;
+    unsigned trace_offset;      // 0 = no trace ring
+    unsigned trace_events;
+    size_t words;
+};
+
+TimingLayout timingLayout(unsigned telemetry_samples, unsigned trace_events) {
+    TimingLayout layout;
+    layout.telemetry_samples = telemetry_samples;
+    layout.trace_offset = trace_events > 0 ? TELEMETRY_HEADER_WORDS + telemetry_samples * TELEMETRY_SAMPLE_WORDS : 0;
+    layout.trace_events = trace_events;
+    layout.words = TELEMETRY_HEADER_WORDS + (size_t)telemetry_samples * TELEMETRY_SAMPLE_WORDS
+                 + (trace_events > 0 ? (size_t)(trace_events + 1) * TRACE_EVENT_WORDS : 0);
+    return layout;
+}
+
+// Events left in the trace ring, oldest first
+std::vector<TraceEvent> collectTrace(const uint32_t* ring, const TimingLayout& layout) {
+    std::vector<TraceEvent> events;
+    for (unsigned i = 0; i < layout.trace_events; i++) {
+        const uint32_t* e = ring + layout.trace_offset + (size_t)(i + 1) * TRACE_EVENT_WORDS;
+        if (e[0] == 0) continue;
+        events.push_back({e[0] - 1, e[1], e[2] >> 24, e[2] & 0xFFFFFF, e[3]});
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent& a, const TraceEvent& b) { return a.seq < b.seq; });
+    return events;
+}
+
+// Host side of the telemetry ring. While the kernel runs, a thread copies
+// the sample ring straight from host-visible memory: a fine-grained SVM
+// buffer with cl2, otherwise a CL_MEM_ALLOC_HOST_PTR buffer that stays
+// mapped during the kernel. Each ring slot remembers the sample it last
+// collected; a sample seen again is refreshed in place, so the final read
+// after the kernel replaces values a copy may have caught half written.
+struct TelemetryPoller {
+    unsigned capacity = 0;
+    std::vector<TelemetrySample>* out = NULL;
+    std::vector<uint32_t> seen;
+    std::vector<size_t> where;      // index in *out of the sample seen in each slot
+    std::chrono::high_resolution_clock::time_point start;
+    std::atomic<bool> stop;
+    std::thread worker;
+
+    void collect(const uint32_t* ring, double host_us) {
+        for (unsigned i = 0; i < capacity; i++) {
+            const uint32_t* sample = ring + TELEMETRY_HEADER_WORDS + (size_t)i * TELEMETRY_SAMPLE_WORDS;
+            uint32_t stamp = sample[0];
+            // the leading stamp (word 5) is written before the fields
+            if (stamp == 0 || sample[5] != stamp) continue;
+            TelemetrySample s = {host_us, stamp - 1, sample[1], (int32_t)sample[2], sample[3], sample[4]};
+            if (stamp == seen[i]) {
+                s.host_us = (*out)[where[i]].host_us;
+                (*out)[where[i]] = s;
+                continue;
+            }
+            seen[i] = stamp;
+            where[i] = out->size();
+            out->push_back(s);
+        }
+    }
+
+    double elapsedUs() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void reset() {
+        seen.assign(capacity, 0);
+        where.assign(capacity, 0);
+        start = std::chrono::high_resolution_clock::now();
+    }
+
+    // Poll the first words of the ring (header and samples) until end()
+    void begin(const volatile uint32_t* ring, size_t words) {
+        stop = false;
+        worker = std::thread([this, ring, words]() {
+            std::vector<uint32_t> copy(words);
+            while (!stop) {
+                for (size_t i = 0; i < words; i++) {
+                    copy[i] = ring[i];
+                }
+                collect(copy.data(), elapsedUs());
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+
+    void end() {
+        stop = true;
+        if (worker.joinable()) worker.join();
+    }
+};
+
+bool eventCompleted(cl_event ev) {
+    cl_int status = CL_QUEUED;
+    return clGetEventInfo(ev, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL) == CL_SUCCESS &&
+           status == CL_COMPLETE;
+}
+
+// Device time of a finished kernel from its START/END profiling stamps. Every
+// measured run (serial, pipelined, autotune, bulk copy) is timed this way.
+bool kernelTimeUs(cl_event ev, long long& time_us) {
+    cl_ulong start = 0, end = 0;
+    if (!eventCompleted(ev) ||
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS ||
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) != CL_SUCCESS ||
+        end <= start) {
+        return false;
+    }
+    time_us = std::max(1LL, (long long)((end - start) / 1000));
+    return true;
+}
+
+// barrier_t::present (kernels/barrier.h): the occupant groups found by
+// -DGRID_BARRIER discovery, 0 when the kernel does not run it
+const unsigned BARRIER_PRESENT_WORD = 9;
+
+// What one sweep launch measured
+struct RunCounts {
+    uint32_t total_ops = 0;
+    uint32_t failed_ops = 0;      // operations given up after FAILSAFE
+    uint32_t active_threads = 0;  // work-items that ran the work: grid barrier occupants, else all
+    long long time_us = 0;
+};
+
+// Sum the metrics buffer (ops of each work-item, then the operations each
+// one gave up, zero for kernels that never give up) and the occupancy
+void countRun(const uint32_t* metrics, int threads, uint32_t present, size_t local_size, RunCounts& counts) {
+    counts.total_ops = 0;
+    counts.failed_ops = 0;
+    for (int i = 0; i < threads; i++) {
+        counts.total_ops += metrics[i];
+        counts.failed_ops += metrics[threads + i];
+    }
+    counts.active_threads = present > 0 ? (uint32_t)(present * local_size) : (uint32_t)threads;
+}
+
+// Run one (kernel, thread count, pattern) configuration on a freshly
+// initialised queue. Returns false if the kernel could not be launched.
+bool runSingleConfig(const DeviceSession& session, cl_program program, cl_kernel kernel,
+                     const std::string& queue_type, unsigned queue_length, int threads, int pattern,
+                     size_t requested_local_size, RunCounts& counts, RunCapture* capture = NULL) {
+    cl_int err;
+    cl_context context = session.context;
+    cl_command_queue command_queue = session.command_queue;
+
+    // Create buffers
+    const size_t barrier_size = 1000 * sizeof(uint32_t);
+    const int operations = SWEEP_OPERATIONS;
+
+    cl_mem barrier_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, barrier_size, NULL, &err);
+    cl_mem queue_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, queueSizeBytes(queue_type, queue_length, session.layout), NULL, &err);
+    std::vector<uint32_t> metrics_data(2 * threads, 0);
+    cl_mem metrics_buf = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                        metrics_data.size() * sizeof(uint32_t), metrics_data.data(), &err);
+    // With telemetry/trace, timing_data holds the sample and event rings
+    const bool sampling = capture != NULL && session.layout.telemetry && session.telemetry_samples > 0;
+    const bool tracing = capture != NULL && session.layout.trace && session.trace_events > 0;
+    const bool live = sampling || tracing;
+    TimingLayout timing = timingLayout(sampling ? session.telemetry_samples : 0, tracing ? session.trace_events : 0);
+    const size_t timing_bytes = std::max(timing.words * sizeof(uint32_t), 10 * sizeof(uint64_t));
+    // The live view reads the ring while the kernel writes it: fine-grained
+    // SVM is coherent with the kernel, a host-allocated buffer kept mapped is
+    // the fallback (zero-copy on most drivers, else samples arrive at the end)
+    uint32_t* svm_ring = NULL;
+    if (sampling && session.telemetry_svm) {
+        svm_ring = (uint32_t*)clSVMAlloc(context, CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER, timing_bytes, 0);
+    }
+    cl_mem timing_buf = NULL;
+    if (svm_ring == NULL) {
+        cl_mem_flags timing_flags = sampling ? CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR
+                                  : live ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY;
+        timing_buf = clCreateBuffer(context, timing_flags, timing_bytes, NULL, &err);
+    }
+    // Zero capacities tell TELEMETRY/TRACE builds not to record (e.g. while autotuning)
+    std::vector<uint32_t> ring(timing_bytes / sizeof(uint32_t), 0);
+    ring[1] = timing.telemetry_samples;
+    ring[2] = timing.trace_offset;
+    ring[3] = timing.trace_events;
+    if (svm_ring != NULL) {
+        std::copy(ring.begin(), ring.end(), svm_ring);
+    } else {
+        clEnqueueWriteBuffer(command_queue, timing_buf, CL_TRUE, 0, timing_bytes, ring.data(), 0, NULL, NULL);
+    }
+
+    bool test_success = false;
+
+    // Initialize queue (same as before)
+    initQueueBuffer(command_queue, queue_buf, queue_type, queue_length, session.layout);
+
+    // Initialize barrier
+    std::vector<uint32_t> barrier_data(1000, 0);
+    clEnqueueWriteBuffer(command_queue, barrier_buf, CL_TRUE, 0, barrier_size, barrier_data.data(), 0, NULL, NULL);
+
+    // FIX 1: Initialize barrier properly to prevent deadlock
+    cl_kernel barr = clCreateKernel(program, "barrier_init", &err);
+    if (err == CL_SUCCESS) {
+        size_t one = 1;
+        clSetKernelArg(barr, 0, sizeof(cl_mem), &barrier_buf);
+        clSetKernelArg(barr, 1, sizeof(uint32_t), &threads);  // grid x-dim
+        clSetKernelArg(barr, 2, sizeof(uint32_t), &one);      // grid y-dim = 1
+        clEnqueueNDRangeKernel(command_queue, barr, 1, NULL, &one, &one, 0, NULL, NULL);
+        clFinish(command_queue);
+        clReleaseKernel(barr);
+    }
+
+    // Set kernel arguments
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &barrier_buf);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), &queue_buf);
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), &metrics_buf);
+    if (svm_ring != NULL) {
+        clSetKernelArgSVMPointer(kernel, 3, svm_ring);
+    } else {
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &timing_buf);
+    }
+    clSetKernelArg(kernel, 4, sizeof(int), &pattern);
+    clSetKernelArg(kernel, 5, sizeof(int), &operations);
+
+    // Launch kernel
+    size_t global_size = threads;
+    size_t local_size = std::min(global_size, requested_local_size);
+    while (global_size % local_size != 0) local_size--;
+
+    TelemetryPoller poller;
+    const volatile uint32_t* live_ring = svm_ring;
+    uint32_t* mapped = NULL;
+    if (sampling) {
+        poller.capacity = timing.telemetry_samples;
+        poller.out = &capture->telemetry;
+        capture->telemetry.clear();
+        poller.reset();
+        if (svm_ring == NULL) {
+            mapped = (uint32_t*)clEnqueueMapBuffer(command_queue, timing_buf, CL_TRUE, CL_MAP_READ, 0, timing_bytes,
+                                                   0, NULL, NULL, &err);
+            live_ring = err == CL_SUCCESS ? mapped : NULL;
+        }
+    }
+
+    cl_event kernel_done = NULL;
+    err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, &kernel_done);
+    if (live) {
+        clFlush(command_queue);
+    }
+    // Start polling once the kernel is submitted
+    if (err == CL_SUCCESS && live_ring != NULL) {
+        poller.begin(live_ring, TELEMETRY_HEADER_WORDS + (size_t)timing.telemetry_samples * TELEMETRY_SAMPLE_WORDS);
+    }
+    if (err == CL_SUCCESS) {
+        clFinish(command_queue);
+        test_success = kernelTimeUs(kernel_done, counts.time_us);
+        clReleaseEvent(kernel_done);
+    }
+    if (test_success) {
+        // Read results
+        clEnqueueReadBuffer(command_queue, metrics_buf, CL_TRUE, 0, metrics_data.size() * sizeof(uint32_t),
+                            metrics_data.data(), 0, NULL, NULL);
+
+        uint32_t present = 0;
+        clEnqueueReadBuffer(command_queue, barrier_buf, CL_TRUE, BARRIER_PRESENT_WORD * sizeof(uint32_t),
+                            sizeof(present), &present, 0, NULL, NULL);
+        countRun(metrics_data.data(), threads, present, local_size, counts);
+    }
+
+    if (live) {
+        poller.end();
+        if (mapped != NULL) {
+            clEnqueueUnmapMemObject(command_queue, timing_buf, mapped, 0, NULL, NULL);
+        }
+        clFinish(command_queue);
+        if (test_success) {
+            // Pick up whatever the live view missed, and the trace events
+            if (svm_ring != NULL) {
+                std::copy(svm_ring, svm_ring + ring.size(), ring.begin());
+            } else {
+                clEnqueueReadBuffer(command_queue, timing_buf, CL_TRUE, 0, timing_bytes, ring.data(), 0, NULL, NULL);
+            }
+            if (sampling) {
+                poller.collect(ring.data(), poller.elapsedUs());
+            }
+            if (tracing) {
+                capture->trace = collectTrace(ring.data(), timing);
+            }
+        }
+        std::sort(capture->telemetry.begin(), capture->telemetry.end(),
+                  [](const TelemetrySample& a, const TelemetrySample& b) { return a.seq < b.seq; });
+    }
+
+    // Cleanup buffers
+    clReleaseMemObject(barrier_buf);
+    clReleaseMemObject(queue_buf);
+    clReleaseMemObject(metrics_buf);
+    if (svm_ring != NULL) {
+        clSVMFree(context, svm_ring);
+    } else {
+        clReleaseMemObject(timing_buf);
+    }
+
+    return test_success;
+}
+
+// One configuration of the throughput sweep
+struct SweepRun {
+    std::string test_name;
+    int threads;
+    int pattern;
+    TuneConfig config;
+    bool tuned;
+};
+
+// Buffers, staging data and events of one in-flight sweep run
+struct PipelineSlot {
+    cl_mem barrier_buf = NULL;
+    cl_mem queue_buf = NULL;
+    cl_mem metrics_buf = NULL;
+    cl_mem timing_buf = NULL;
+    size_t queue_bytes = 0;
+    int metrics_threads = 0;
+    std::vector<uint32_t> queue_init;    // must outlive the non-blocking writes
+    std::vector<uint32_t> barrier_init;
+    std::vector<uint32_t> metrics;       // target of the non-blocking read
+    uint32_t present = 0;                // barrier_t::present, read with the metrics
+    size_t local_size = 0;
+    cl_kernel kernel = NULL;
+    cl_kernel barr = NULL;
+    std::vector<cl_event> setup_events;
+    cl_event kernel_done = NULL;
+    cl_event read_done = NULL;
+    cl_event present_done = NULL;
+    bool busy = false;
+    SweepRun run;
+};
+
+// Double-buffered sweep executor. Each run is an event chain on the
+// session's profiling queue (upload -> barrier_init -> kernel -> metrics
+// read, none of them blocking); kernels also wait for the previous kernel so
+// they never share the device. A slot is harvested only when it is reused,
+// so the next run's uploads and barrier_init overlap the running kernel.
+// Kernel time comes from the event profiling counters.
+struct SweepPipeline {
+    const DeviceSession* session;
+    std::string queue_type;
+    std::function<void(const SweepRun&, bool, const RunCounts&)> harvest;
+    PipelineSlot slots[2];
+    unsigned next = 0;
+    cl_event last_kernel = NULL;  // owned by the slot that launched it
+
+    // Queue a run; kernel is owned by the pipeline from here on
+    void submit(cl_program program, cl_kernel kernel, const SweepRun& run) {
+        PipelineSlot& slot = slots[next];
+        next ^= 1;
+        finish(slot);
+
+        cl_int err;
+        cl_context context = session->context;
+        cl_command_queue queue = session->pipeline_queue;
+
+        // Grow the slot's buffers when this configuration needs more room
+        size_t queue_bytes = queueSizeBytes(queue_type, run.config.queue_length, session->layout);
+        if (slot.queue_bytes < queue_bytes) {
+            if (slot.queue_buf) clReleaseMemObject(slot.queue_buf);
+            slot.queue_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, queue_bytes, NULL, &err);
+            slot.queue_bytes = queue_bytes;
+        }
+        if (slot.metrics_threads < run.threads) {
+            if (slot.metrics_buf) clReleaseMemObject(slot.metrics_buf);
+            slot.metrics_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * run.threads * sizeof(uint32_t), NULL, &err);
+            slot.metrics_threads = run.threads;
+        }
+        if (slot.barrier_buf == NULL) {
+            slot.barrier_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, 1000 * sizeof(uint32_t), NULL, &err);
+            // zeroed like runSingleConfig's: no telemetry/trace capacity
+            std::vector<uint64_t> timing(10, 0);
+            slot.timing_buf = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                             timing.size() * sizeof(uint64_t), timing.data(), &err);
+        }
+
+        slot.run = run;
+        slot.busy = true;
+        slot.kernel = kernel;
+        slot.queue_init = queueInitData(queue_type, run.config.queue_length, session->layout);
+        slot.barrier_init.assign(1000, 0);
+        slot.metrics.assign(2 * run.threads, 0);
+
+        // Uploads
+        cl_event ev;
+        if (clEnqueueWriteBuffer(queue, slot.queue_buf, CL_FALSE, 0, slot.queue_init.size() * sizeof(uint32_t),
+                                 slot.queue_init.data(), 0, NULL, &ev) == CL_SUCCESS) {
+            slot.setup_events.push_back(ev);
+        }
+        if (clEnqueueWriteBuffer(queue, slot.barrier_buf, CL_FALSE, 0, slot.barrier_init.size() * sizeof(uint32_t),
+                                 slot.barrier_init.data(), 0, NULL, &ev) == CL_SUCCESS) {
+            slot.setup_events.push_back(ev);
+        }
+        // failed-op counters start at zero; kernels that never give up leave them
+        if (clEnqueueWriteBuffer(queue, slot.metrics_buf, CL_FALSE, 0, slot.metrics.size() * sizeof(uint32_t),
+                                 slot.metrics.data(), 0, NULL, &ev) == CL_SUCCESS) {
+            slot.setup_events.push_back(ev);
+        }
+
+        // Barrier initialisation after the uploads
+        int threads = run.threads;
+        slot.barr = clCreateKernel(program, "barrier_init", &err);
+        if (err == CL_SUCCESS) {
+            size_t one = 1;
+            clSetKernelArg(slot.barr, 0, sizeof(cl_mem), &slot.barrier_buf);
+            clSetKernelArg(slot.barr, 1, sizeof(uint32_t), &threads);  // grid x-dim
+            clSetKernelArg(slot.barr, 2, sizeof(uint32_t), &one);      // grid y-dim = 1
+            if (clEnqueueNDRangeKernel(queue, slot.barr, 1, NULL, &one, &one, (cl_uint)slot.setup_events.size(),
+                                       slot.setup_events.data(), &ev) == CL_SUCCESS) {
+                slot.setup_events.push_back(ev);
+            }
+        } else {
+            slot.barr = NULL;
+        }
+
+        // Kernel after its own setup and the previous kernel
+        const int operations = SWEEP_OPERATIONS;
+        clSetKernelArg(kernel, 0, sizeof(cl_mem), &slot.barrier_buf);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &slot.queue_buf);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &slot.metrics_buf);
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &slot.timing_buf);
+        clSetKernelArg(kernel, 4, sizeof(int), &run.pattern);
+        clSetKernelArg(kernel, 5, sizeof(int), &operations);
+
+        size_t global_size = run.threads;
+        size_t local_size = std::min(global_size, run.config.local_size);
+        while (global_size % local_size != 0) local_size--;
+
+        std::vector<cl_event> deps = slot.setup_events;
+        if (last_kernel != NULL) deps.push_back(last_kernel);
+        err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &local_size,
+                                     (cl_uint)deps.size(), deps.empty() ? NULL : deps.data(), &slot.kernel_done);
+        slot.local_size = local_size;
+        slot.present = 0;
+        if (err == CL_SUCCESS) {
+            last_kernel = slot.kernel_done;
+            clEnqueueReadBuffer(queue, slot.metrics_buf, CL_FALSE, 0, slot.metrics.size() * sizeof(uint32_t),
+                                slot.metrics.data(), 1, &slot.kernel_done, &slot.read_done);
+            clEnqueueReadBuffer(queue, slot.barrier_buf, CL_FALSE, BARRIER_PRESENT_WORD * sizeof(uint32_t),
+                                sizeof(uint32_t), &slot.present, 1, &slot.kernel_done, &slot.present_done);
+        } else {
+            slot.kernel_done = NULL;
+        }
+        clFlush(queue);
+    }
+
+    // Harvest every outstanding run in submission order
+    void drain() {
+        finish(slots[next]);
+        finish(slots[next ^ 1]);
+    }
+
+    void release() {
+        drain();
+        for (PipelineSlot& slot : slots) {
+            if (slot.barrier_buf) clReleaseMemObject(slot.barrier_buf);
+            if (slot.queue_buf) clReleaseMemObject(slot.queue_buf);
+            if (slot.metrics_buf) clReleaseMemObject(slot.metrics_buf);
+            if (slot.timing_buf) clReleaseMemObject(slot.timing_buf);
+            slot = PipelineSlot();
+        }
+    }
+
+private:
+    // Wait for the slot's run, report it and release its events and kernels
+    void finish(PipelineSlot& slot) {
+        if (!slot.busy) return;
+        std::vector<cl_event> pending = slot.setup_events;
+        if (slot.read_done != NULL) pending.push_back(slot.read_done);
+        if (slot.present_done != NULL) pending.push_back(slot.present_done);
+        bool ok = slot.read_done != NULL && slot.present_done != NULL;
+        if (!pending.empty() && clWaitForEvents((cl_uint)pending.size(), pending.data()) != CL_SUCCESS) {
+            ok = false;
+        }
+
+        // A kernel that aborted or failed has a negative execution status
+        RunCounts counts;
+        if (ok) {
+            ok = eventCompleted(slot.read_done) && eventCompleted(slot.present_done) &&
+                 kernelTimeUs(slot.kernel_done, counts.time_us);
+        }
+        if (ok) {
+            countRun(slot.metrics.data(), slot.run.threads, slot.present, slot.local_size, counts);
+        }
+
+        for (cl_event ev : slot.setup_events) clReleaseEvent(ev);
+        slot.setup_events.clear();
+        if (last_kernel == slot.kernel_done) last_kernel = NULL;
+        if (slot.kernel_done) clReleaseEvent(slot.kernel_done);
+        if (slot.read_done) clReleaseEvent(slot.read_done);
+        if (slot.present_done) clReleaseEvent(slot.present_done);
+        slot.kernel_done = NULL;
+        slot.read_done = NULL;
+        slot.present_done = NULL;
+        if (slot.barr) clReleaseKernel(slot.barr);
+        clReleaseKernel(slot.kernel);
+        slot.barr = NULL;
+        slot.kernel = NULL;
+        slot.busy = false;
+
+        harvest(slot.run, ok, counts);
+    }
+};
+
+// Candidate configurations for the autotuner. The same seeded sample is used
+// for every (test, pattern) of a queue type so their programs are shared.
+std::vector<TuneConfig> tuneCandidates(const TuneConfig& defaults, size_t max_local_size, int threads) {
+    std::vector<unsigned> lengths = {1024, 2048, 4096, 8192, 16384};
+    std::vector<unsigned> failsafes = {250, 1000, 4000, 16000};
+    std::vector<unsigned> works = {0, 25, 100, 400};
+    std::vector<size_t> local_sizes = {32, 64, 128, 256, 512};
+
+    std::vector<TuneConfig> grid;
+    for (unsigned length : lengths) {
+        for (unsigned failsafe : failsafes) {
+            for (unsigned work : works) {
+                for (size_t local_size : local_sizes) {
+                    if (local_size > max_local_size || local_size > (size_t)threads) continue;
+                    TuneConfig config = defaults;
+                    config.queue_length = length;
+                    config.failsafe = failsafe;
+                    config.work = work;
+                    config.local_size = local_size;
+                    grid.push_back(config);
+                }
+            }
+        }
+    }
+
+    std::mt19937 rng(1234);
+    std::shuffle(grid.begin(), grid.end(), rng);
+
+    const size_t max_candidates = 16;
+    std::vector<TuneConfig> candidates = {defaults};
+    for (const auto& config : grid) {
+        if (candidates.size() >= max_candidates) break;
+        candidates.push_back(config);
+    }
+    return candidates;
+}
+
+// Mean throughput of a configuration over reps launches, 0 if it fails to build or launch
+double evaluateConfig(DeviceSession& session, ProgramCache& cache, const std::string& queue_type,
+                      const std::string& test_name, int pattern, int threads, const TuneConfig& config,
+                      int reps, std::ostream& log) {
+    cl_program program = cache.get(makeBuildOptions(queue_type, session, config), log);
+    if (program == NULL) {
+        return 0;
+    }
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, test_name.c_str(), &err);
+    if (err != CL_SUCCESS) {
+        return 0;
+    }
+
+    double sum = 0;
+    for (int r = 0; r < reps; r++) {
+        RunCounts counts;
+        // a configuration that drops operations does not score
+        if (!runSingleConfig(session, program, kernel, queue_type, config.queue_length, threads, pattern,
+                             config.local_size, counts) || counts.failed_ops > 0) {
+            clReleaseKernel(kernel);
+            return 0;
+        }
+        sum += counts.total_ops / (std::max(counts.time_us, 1LL) / 1000000.0);
+    }
+    clReleaseKernel(kernel);
+    return sum / reps;
+}
+
+// Successive halving over the candidate configurations for every test and
+// pattern of one queue type. Each round splits an equal share of the budget
+// over the survivors and keeps the better half.
+void autotuneQueue(DeviceSession& session, ProgramCache& cache, const std::string& queue_type,
+                   const TuneConfig& defaults, const RunOptions& options, TuneProfile& profile,
+                   std::ostream& log) {
+    log << "\n=== Autotuning " << queue_type << " (budget " << options.tune_budget
+        << " launches per pattern, " << options.tune_threads << " threads) ===" << std::endl;
+
+    size_t max_local_size = 256;
+    clGetDeviceInfo(session.device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_local_size), &max_local_size, NULL);
+
+    std::vector<std::string> test_names = {
+        "scheduler_simulation",
+        "bfs_simulation",
+        "burst_pattern_test",
+        "contention_pattern_test"
+    };
+    std::vector<int> pattern_types = {0, 1, 2, 3};
+    const int threads = options.tune_threads;
+    const std::string variant = queueVariantName(queue_type, session.layout);
+
+    for (const auto& test_name : test_names) {
+        for (int pattern : pattern_types) {
+            std::vector<TuneConfig> candidates = tuneCandidates(defaults, max_local_size, threads);
+
+            int rounds = 0;
+            for (size_t m = candidates.size(); m > 1; m = (m + 1) / 2) rounds++;
+            int per_round = std::max(1, options.tune_budget / std::max(1, rounds));
+
+            double best_score = 0;
+            while (candidates.size() > 1) {
+                int reps = std::max(1, per_round / (int)candidates.size());
+                std::vector<std::pair<double, size_t>> scored;
+                for (size_t c = 0; c < candidates.size(); c++) {
+                    scored.push_back(std::make_pair(
+                        evaluateConfig(session, cache, queue_type, test_name, pattern, threads, candidates[c], reps, log), c));
+                }
+                std::stable_sort(scored.begin(), scored.end(),
+                                 [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+                                     return a.first > b.first;
+                                 });
+
+                std::vector<TuneConfig> survivors;
+                for (size_t k = 0; k < (candidates.size() + 1) / 2; k++) {
+                    survivors.push_back(candidates[scored[k].second]);
+                }
+                best_score = scored[0].first;
+                candidates = survivors;
+            }
+
+            const TuneConfig& best = candidates[0];
+            if (best_score <= 0) {
+                // every candidate failed to build or run: keep the defaults
+                log << test_name << " - Pattern: " << pattern << ", no working configuration, not stored" << std::endl;
+                continue;
+            }
+            profile[profileKey(queue_type, variant, threads, test_name, pattern)] = ProfileEntry{best, best_score};
+            log << test_name << " - Pattern: " << pattern
+                << ", best: queue_length=" << best.queue_length
+                << " failsafe=" << best.failsafe
+                << " work=" << best.work
+                << " local_size=" << best.local_size
+                << ", Throughput: " << best_score << " ops/sec" << std::endl;
+        }
+    }
+}
+
+bool openDeviceSession(cl_device_id device, const std::string& label, const RunOptions& options,
+                       DeviceSession& session, std::ostream& log) {
+    cl_int err;
+    session.device = device;
+    session.label = label;
+    session.vendor = getVendorName(device);
+
+    // Resolve the queue layout; zero means "follow the device's cache line"
+    cl_uint line_bytes = 0;
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, sizeof(line_bytes), &line_bytes, NULL);
+    unsigned line_words = line_bytes >= 2 * sizeof(uint32_t) ? line_bytes / sizeof(uint32_t) : 16;
+    session.layout.sfq_layout = options.sfq_layout;
+    session.layout.sfq_line_words = options.sfq_line_words > 0 ? options.sfq_line_words : line_words;
+    // GET_TARGET is only a permutation for power-of-two strides, so an odd
+    // line size (e.g. 48 words) is rounded down
+    unsigned line_swizzle = 1;
+    while (line_swizzle * 2 <= line_words) line_swizzle *= 2;
+    session.layout.sfq_swizzle = options.sfq_swizzle > 0 ? options.sfq_swizzle : line_swizzle;
+    session.layout.tz_scan_width = options.tz_scan_width;
+    session.layout.ms_wide = options.ms_wide;
+    session.layout.grid_barrier = options.grid_barrier;
+
+    // C11 atomics need an OpenCL C 2.0 compiler; fall back to the 1.2 macros otherwise
+    bool has_cl2 = getOpenCLCVersion(device) >= 200;
+    if (options.cl2_atomics > 0 && !has_cl2) {
+        log << "Warning: device has no OpenCL C 2.0, using OpenCL 1.2 atomics" << std::endl;
+    }
+    session.layout.cl2_atomics = options.cl2_atomics != 0 && has_cl2;
+
+    // Telemetry time series go to <prefix>_<device>.csv
+    if (!options.telemetry.empty()) {
+        session.layout.telemetry = true;
+        session.telemetry_samples = options.telemetry_samples;
+        session.telemetry_path = options.telemetry + "_" + sessionFileTag(label) + ".csv";
+        std::ofstream csv(session.telemetry_path);
+        csv << "queue,test,variant,threads,pattern,host_us,seq,group,depth,ops,retries" << std::endl;
+        log << "Telemetry: " << session.telemetry_path << std::endl;
+    }
+
+    // Chrome trace (JSON array format, the closing bracket is optional) in <prefix>_<device>.json
+    if (!options.trace.empty()) {
+        session.layout.trace = true;
+        session.trace_events = options.trace_events;
+        session.trace_timer = options.trace_timer && session.vendor.find("NVIDIA") != std::string::npos;
+        session.trace_path = options.trace + "_" + sessionFileTag(label) + ".json";
+        std::ofstream json(session.trace_path);
+        json << "[" << std::endl;
+        log << "Trace: " << session.trace_path
+            << (session.trace_timer ? " (device timer)" : " (logical clock)") << std::endl;
+    }
+
     // Create context and command queue
-    cl_context context = clCreateContext(NULL, 1, &gpu_device, NULL, NULL, &err);
+    session.context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
     if (err != CL_SUCCESS) {
-        std::cerr << "Failed to create context!" << std::endl;
-        return 1;
+        log << "Failed to create context!" << std::endl;
+        return false;
+    }
+
+    // Profiling stamps time every measured kernel (kernelTimeUs)
+    session.command_queue = clCreateCommandQueue(session.context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (err != CL_SUCCESS) {
+        log << "Failed to create command queue!" << std::endl;
+        clReleaseContext(session.context);
+        return false;
     }
-    
-    cl_command_queue command_queue = clCreateCommandQueue(context, gpu_device, 0, &err);
+
+    // The pipelined sweep orders its commands with events; fall back to an
+    // in-order queue on devices without out-of-order execution
+    session.pipeline_queue = clCreateCommandQueue(session.context, device,
+        CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE, &err);
     if (err != CL_SUCCESS) {
-        std::cerr << "Failed to create command queue!" << std::endl;
-        return 1;
+        session.pipeline_queue = clCreateCommandQueue(session.context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    }
+    if (err != CL_SUCCESS) {
+        log << "Failed to create profiling command queue!" << std::endl;
+        clReleaseCommandQueue(session.command_queue);
+        clReleaseContext(session.context);
+        return false;
+    }
+
+    // cl2 builds put the telemetry ring in fine-grained SVM when the device has it
+    if (session.layout.telemetry && session.layout.cl2_atomics) {
+        cl_device_svm_capabilities svm = 0;
+        clGetDeviceInfo(device, CL_DEVICE_SVM_CAPABILITIES, sizeof(svm), &svm, NULL);
+        session.telemetry_svm = (svm & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0;
+        if (!session.telemetry_svm) {
+            log << "Warning: no fine-grained SVM buffers, telemetry uses a mapped host buffer" << std::endl;
+        }
+    }
+
+    // Workload specs are compiled once and shared by every workload_test launch
+    if (!options.workloads.empty()) {
+        std::vector<uint32_t> table = compileWorkloads(options.workloads);
+        session.workload_table = clCreateBuffer(session.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                table.size() * sizeof(uint32_t), table.data(), &err);
+        if (err != CL_SUCCESS) {
+            log << "Failed to create workload table, skipping workloads" << std::endl;
+            session.workload_table = NULL;
+        } else {
+            for (const Workload& workload : options.workloads) {
+                session.workloads.push_back(workload);
+            }
+        }
+    }
+    return true;
+}
+
+void closeDeviceSession(DeviceSession& session) {
+    if (session.workload_table != NULL) {
+        clReleaseMemObject(session.workload_table);
+    }
+    clReleaseCommandQueue(session.pipeline_queue);
+    clReleaseCommandQueue(session.command_queue);
+    clReleaseContext(session.context);
+}
+
+// Forward declaration
+std::vector<ThroughputResult> runThroughputTest(DeviceSession& session, ProgramCache& cache,
+                      const std::string& queue_type, const TuneConfig& defaults,
+                      const TuneProfile& profile, bool pipelined, std::ostream& log);
+
+// Move input[] to output[] through the queue in chunks of each size in
+// options.copy_chunks (generic_queue_copy_test), check the copy and report
+// chunks/sec, ints/sec and GB/s (bytes read plus bytes written). Runs that
+// lose chunks or corrupt the output are reported as failed, not measured.
+std::vector<CopyResult> runCopyBenchmark(DeviceSession& session, ProgramCache& cache,
+                                         const std::string& queue_type, const TuneConfig& config,
+                                         const RunOptions& options, std::ostream& log) {
+    std::vector<CopyResult> results;
+    log << "\n=== Running Bulk Copy Tests ===" << std::endl;
+
+    cl_program program = cache.get(makeBuildOptions(queue_type, session, config), log);
+    if (program == NULL) {
+        log << "Failed to build the bulk copy test" << std::endl;
+        return results;
+    }
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, "generic_queue_copy_test", &err);
+    if (err != CL_SUCCESS) {
+        log << "Kernel generic_queue_copy_test not available, skipping..." << std::endl;
+        return results;
+    }
+
+    // A few groups per compute unit, each copying with the whole work-group
+    cl_uint compute_units = 1;
+    size_t max_local_size = 256;
+    clGetDeviceInfo(session.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    clGetDeviceInfo(session.device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_local_size), &max_local_size, NULL);
+    size_t local_size = std::min(config.local_size, max_local_size);
+    const unsigned groups = std::max(1u, (unsigned)compute_units * 4);
+    size_t global_size = groups * local_size;
+
+    const int elements = (int)options.copy_elements;
+    const size_t bytes = (size_t)elements * sizeof(int);
+    std::vector<int> input(elements);
+    for (int i = 0; i < elements; i++) {
+        input[i] = i * 7 + 1;
+    }
+    const size_t barrier_size = 1000 * sizeof(uint32_t);
+    cl_mem barrier_buf = clCreateBuffer(session.context, CL_MEM_READ_WRITE, barrier_size, NULL, &err);
+    cl_mem queue_buf = clCreateBuffer(session.context, CL_MEM_READ_WRITE,
+                                      queueSizeBytes(queue_type, config.queue_length, session.layout), NULL, &err);
+    cl_mem input_buf = clCreateBuffer(session.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, input.data(), &err);
+    cl_mem output_buf = clCreateBuffer(session.context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+    cl_mem metrics_buf = clCreateBuffer(session.context, CL_MEM_WRITE_ONLY, groups * sizeof(uint32_t), NULL, &err);
+    // Zeroed telemetry/trace header: no capacity, so the copy emits nothing
+    uint32_t timing_header[TELEMETRY_HEADER_WORDS] = {0};
+    cl_mem timing_buf = clCreateBuffer(session.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                       sizeof(timing_header), timing_header, &err);
+    cl_command_queue command_queue = session.command_queue;
+    const std::string variant = queueVariantName(queue_type, session.layout);
+
+    for (int chunk : options.copy_chunks) {
+        const uint32_t chunks = (uint32_t)((elements + chunk - 1) / chunk);
+        initQueueBuffer(command_queue, queue_buf, queue_type, config.queue_length, session.layout);
+        std::vector<uint32_t> barrier_data(1000, 0);
+        clEnqueueWriteBuffer(command_queue, barrier_buf, CL_TRUE, 0, barrier_size, barrier_data.data(), 0, NULL, NULL);
+        cl_kernel barr = clCreateKernel(program, "barrier_init", &err);
+        if (err == CL_SUCCESS) {
+            size_t one = 1;
+            clSetKernelArg(barr, 0, sizeof(cl_mem), &barrier_buf);
+            clSetKernelArg(barr, 1, sizeof(uint32_t), &groups);  // grid x-dim
+            clSetKernelArg(barr, 2, sizeof(uint32_t), &one);     // grid y-dim = 1
+            clEnqueueNDRangeKernel(command_queue, barr, 1, NULL, &one, &one, 0, NULL, NULL);
+            clFinish(command_queue);
+            clReleaseKernel(barr);
+        }
+        std::vector<int> output(elements, 0);
+        clEnqueueWriteBuffer(command_queue, output_buf, CL_TRUE, 0, bytes, output.data(), 0, NULL, NULL);
+
+        clSetKernelArg(kernel, 0, sizeof(cl_mem), &barrier_buf);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &queue_buf);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &input_buf);
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &output_buf);
+        clSetKernelArg(kernel, 4, sizeof(cl_mem), &metrics_buf);
+        clSetKernelArg(kernel, 5, sizeof(cl_mem), &timing_buf);
+        clSetKernelArg(kernel, 6, sizeof(int), &elements);
+        clSetKernelArg(kernel, 7, sizeof(int), &chunk);
+
+        cl_event kernel_done = NULL;
+        err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, &kernel_done);
+        if (err != CL_SUCCESS) {
+            log << "Failed to launch bulk copy with chunk " << chunk << ", error " << err << std::endl;
+            continue;
+        }
+        clFinish(command_queue);
+        long long time_us = 0;
+        const bool timed = kernelTimeUs(kernel_done, time_us);
+        clReleaseEvent(kernel_done);
+        if (!timed) {
+            log << "bulk_copy - Chunk: " << chunk << " ints FAILED: kernel did not complete" << std::endl;
+            continue;
+        }
+
+        std::vector<uint32_t> metrics(groups);
+        clEnqueueReadBuffer(command_queue, metrics_buf, CL_TRUE, 0, groups * sizeof(uint32_t), metrics.data(), 0, NULL, NULL);
+        clEnqueueReadBuffer(command_queue, output_buf, CL_TRUE, 0, bytes, output.data(), 0, NULL, NULL);
+        uint32_t copied = 0;
+        for (uint32_t m : metrics) {
+            copied += m;
+        }
+        size_t mismatches = 0;
+        for (int i = 0; i < elements; i++) {
+            mismatches += output[i] != input[i];
+        }
+
+        if (copied != chunks || mismatches != 0) {
+            log << "bulk_copy - Chunk: " << chunk << " ints FAILED: " << copied << "/" << chunks
+                << " chunks copied, " << mismatches << " of " << elements << " ints differ" << std::endl;
+            continue;
+        }
+
+        double seconds = time_us / 1000000.0;
+        CopyResult result = {session.label, queue_type, variant, chunk, global_size, chunks, time_us,
+                             chunks / seconds, elements / seconds, 2.0 * bytes / seconds / 1e9};
+        log << "bulk_copy - Chunk: " << chunk << " ints"
+            << ", Chunks: " << chunks
+            << ", Work-items: " << global_size
+            << ", Time: " << time_us << "us"
+            << ", Throughput: " << result.chunks_per_sec << " chunks/sec, "
+            << result.ints_per_sec << " ints/sec"
+            << ", Bandwidth: " << result.gbps << " GB/s";
+        if (!variant.empty()) {
+            log << ", Layout: " << variant;
+        }
+        log << ", output verified" << std::endl;
+
+        results.push_back(result);
     }
-    
+
+    clReleaseMemObject(barrier_buf);
+    clReleaseMemObject(queue_buf);
+    clReleaseMemObject(input_buf);
+    clReleaseMemObject(output_buf);
+    clReleaseMemObject(metrics_buf);
+    clReleaseMemObject(timing_buf);
+    clReleaseKernel(kernel);
+    return results;
+}
+
+// Build the dispatch program for one queue type, run the simple test, the
+// validation test and the throughput sweep. Results are appended to results.
+bool runQueueBenchmarks(DeviceSession& session, const std::string& queue_type, const RunOptions& options,
+                        std::ostream& log, std::vector<ThroughputResult>& results,
+                        std::vector<CopyResult>& copies) {
+    cl_int err;
+    cl_context context = session.context;
+    cl_command_queue command_queue = session.command_queue;
+
+    log << "Testing " << queue_type << " queue..." << std::endl;
+
     // Read kernel source
     std::ifstream srcFile("kernels/queue_dispatch.cl");
     if (!srcFile) {
-        std::cerr << "Error: Could not open kernels/queue_dispatch.cl" << std::endl;
-        return 1;
-    }
-    std::string src(std::istreambuf_iterator<char>(srcFile), (std::istreambuf_iterator<char>()));
-    
-    // Build options
-    std::string buildOpts = "-I./kernels -DMY_QUEUE_LENGTH=4096 -DMY_QUEUE_FACTOR=12 -DGROUPS=256 -DWORK=100";
-    
-    // Queue-specific defines
-    if (queue_type == "sfq") {
-        buildOpts += " -DUSE_SFQ_QUEUE";
-    } else if (queue_type == "ms") {
-        buildOpts += " -DUSE_MS_QUEUE";
-    } else if (queue_type == "tz") {
-        buildOpts += " -DUSE_TZ_QUEUE";
+        log << "Error: Could not open kernels/queue_dispatch.cl" << std::endl;
+        return false;
     }
-    
-    // Vendor-specific optimizations with reasonable failsafe values
-    if (vendor.find("AMD") != std::string::npos) {
-        buildOpts += " -DAMD -DWARP=64 -DFAILSAFE=1000";
-    } else if (vendor.find("NVIDIA") != std::string::npos) {
-        buildOpts += " -DNVIDIA -DWARP=32 -DFAILSAFE=1000";
-    } else if (vendor.find("Intel") != std::string::npos) {
-        buildOpts += " -DINTEL -DWARP=16 -DFAILSAFE=1000";
+    ProgramCache cache;
+    cache.context = context;
+    cache.device = session.device;
+    cache.src.assign(std::istreambuf_iterator<char>(srcFile), (std::istreambuf_iterator<char>()));
+
+    TuneConfig defaults = defaultTuneConfig(session.vendor);
+    if (options.queue_length > 0) {
+        defaults.queue_length = options.queue_length;
     }
-    
-    std::cout << "Build options: " << buildOpts << std::endl;
-    
-    // Create and build program
-    const char* src_ptr = src.c_str();
-    size_t src_size = src.length();
-    cl_program program = clCreateProgramWithSource(context, 1, &src_ptr, &src_size, &err);
-    if (err != CL_SUCCESS) {
-        std::cerr << "Failed to create program!" << std::endl;
-        return 1;
+    std::string buildOpts = makeBuildOptions(queue_type, session, defaults);
+    log << "Build options: " << buildOpts << std::endl;
+    if (!queueVariantName(queue_type, session.layout).empty()) {
+        log << "Queue layout: " << queueVariantName(queue_type, session.layout) << std::endl;
     }
-    
-    err = clBuildProgram(program, 1, &gpu_device, buildOpts.c_str(), NULL, NULL);
-    if (err != CL_SUCCESS) {
-        std::cerr << "Build failed!" << std::endl;
-        size_t log_size;
-        clGetProgramBuildInfo(program, gpu_device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        std::vector<char> log(log_size);
-        clGetProgramBuildInfo(program, gpu_device, CL_PROGRAM_BUILD_LOG, log_size, log.data(), NULL);
-        std::cerr << "Build log: " << log.data() << std::endl;
-        return 1;
+
+    cl_program program = cache.get(buildOpts, log);
+    if (program == NULL) {
+        return false;
     }
-    
-    std::cout << "Kernel built successfully!" << std::endl;
-    
+
+    log << "Kernel built successfully!" << std::endl;
+
     // Calculate queue size
-    size_t queue_size;
+    const unsigned queue_length = defaults.queue_length;
+    size_t queue_size = queueSizeBytes(queue_type, queue_length, session.layout);
     if (queue_type == "ms") {
-        queue_size = sizeof(ms_queue_layout);
-        std::cout << "MS Queue size: " << queue_size << " bytes" << std::endl;
-    } else if (queue_type == "sfq") {
-        queue_size = 4096 * 3 * sizeof(uint32_t);
-    } else if (queue_type == "tz") {
-        queue_size = (4096 + 5) * sizeof(uint32_t);
+        log << "MS Queue size: " << queue_size << " bytes" << std::endl;
     }
-    
+
     // Run simple test first
-    std::cout << "\n=== Running Simple Test ===" << std::endl;
-    
+    log << "\n=== Running Simple Test ===" << std::endl;
+
     // Create kernel
     cl_kernel kernel = clCreateKernel(program, "simple_queue_test", &err);
     if (err != CL_SUCCESS) {
-        std::cerr << "Failed to create simple_queue_test kernel! Error: " << err << std::endl;
-        return 1;
+        log << "Failed to create simple_queue_test kernel! Error: " << err << std::endl;
+        cache.release();
+        return false;
     }
-    
+
     const size_t barrier_size = 1000 * sizeof(uint32_t);
     const int num_threads = 64;
-    
+
     cl_mem barrier_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, barrier_size, NULL, &err);
     cl_mem queue_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, queue_size, NULL, &err);
     cl_mem metrics_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_threads * 2 * sizeof(uint32_t), NULL, &err);
     cl_mem timing_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 10 * sizeof(uint64_t), NULL, &err);
-    
+
     // Initialize queue data
-    if (queue_type == "sfq") {
-        std::vector<uint32_t> init_data(4096 * 3, 0);
-        clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
-    } else if (queue_type == "ms") {
-        ms_queue_layout init_queue = {};
-        
-        // Initialize head and tail to point to dummy node (node 1)
-        init_queue.head.ptr = 1;
-        init_queue.head.count = 0;
-        init_queue.tail.ptr = 1;
-        init_queue.tail.count = 0;
-        
-        // Initialize nodes
-        for (int i = 0; i < 4097; i++) {
-            if (i == 1) {
-                init_queue.nodes[i].free = 1; // FREE_FALSE - dummy node is occupied
-                init_queue.nodes[i].value = 0;
-                init_queue.nodes[i].next.ptr = 0;
-                init_queue.nodes[i].next.count = 0;
-            } else {
-                init_queue.nodes[i].free = 0; // FREE_TRUE - available
-                init_queue.nodes[i].value = 0;
-                init_queue.nodes[i].next.ptr = 0;
-                init_queue.nodes[i].next.count = 0;
-            }
-        }
-        
-        // Initialize hazard arrays to UINT_MAX
-        for (int i = 0; i < 1500; i++) {
-            init_queue.hazard1[i] = UINT_MAX;
-            init_queue.hazard2[i] = UINT_MAX;
-        }
-        
-        init_queue.base_spin = 0;
-        
-        clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, sizeof(ms_queue_layout), &init_queue, 0, NULL, NULL);
-        std::cout << "MS queue initialized with dummy node at index 1" << std::endl;
-    } else if (queue_type == "tz") {
-        std::vector<uint32_t> init_data(4096 + 5, 0);
-        init_data[0] = 0;  // head
-        init_data[1] = 1;  // tail
-        init_data[2] = 4294967295;  // vnull
-        for (int i = 3; i < 4096 + 5; i++) {
-            init_data[i] = 4294967294;  // null_0
-        }
-        init_data[3] = 4294967295;  // first to null_1
-        clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
+    initQueueBuffer(command_queue, queue_buf, queue_type, queue_length, session.layout);
+    if (queue_type == "ms") {
+        log << "MS queue initialized with dummy node at index 1" << std::endl;
     }
-    
+
     // Initialize barrier
     std::vector<uint32_t> barrier_data(1000, 0);
     clEnqueueWriteBuffer(command_queue, barrier_buf, CL_TRUE, 0, barrier_size, barrier_data.data(), 0, NULL, NULL);
-    
+
     // Set kernel arguments
     clSetKernelArg(kernel, 0, sizeof(cl_mem), &barrier_buf);
     clSetKernelArg(kernel, 1, sizeof(cl_mem), &queue_buf);
@@ -262,32 +1809,38 @@ int main(int argc, char **argv) {
     int operations = 1000;
     clSetKernelArg(kernel, 4, sizeof(int), &pattern);
     clSetKernelArg(kernel, 5, sizeof(int), &operations);
-    
+
     // Launch kernel
     size_t global_size = 64;
     size_t local_size = 32;
-    
-    std::cout << "Launching simple test with " << global_size << " threads..." << std::endl;
-    
+
+    log << "Launching simple test with " << global_size << " threads..." << std::endl;
+
     auto start = std::chrono::high_resolution_clock::now();
-    
+
     err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
     if (err != CL_SUCCESS) {
-        std::cerr << "Failed to launch simple test kernel! Error: " << err << std::endl;
-        return 1;
+        log << "Failed to launch simple test kernel! Error: " << err << std::endl;
+        clReleaseKernel(kernel);
+        clReleaseMemObject(barrier_buf);
+        clReleaseMemObject(queue_buf);
+        clReleaseMemObject(metrics_buf);
+        clReleaseMemObject(timing_buf);
+        cache.release();
+        return false;
     }
-    
+
     clFinish(command_queue);
-    
+
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    
-    std::cout << "Simple test completed in " << duration.count() << " ms" << std::endl;
-    
+
+    log << "Simple test completed in " << duration.count() << " ms" << std::endl;
+
     // Read results
     std::vector<uint32_t> metrics(num_threads * 2);
     clEnqueueReadBuffer(command_queue, metrics_buf, CL_TRUE, 0, num_threads * 2 * sizeof(uint32_t), metrics.data(), 0, NULL, NULL);
-    
+
     // Calculate total operations
     uint32_t total_ops = 0;
     uint32_t total_failures = 0;
@@ -295,299 +1848,703 @@ int main(int argc, char **argv) {
         total_ops += metrics[i * 2];
         total_failures += metrics[i * 2 + 1];
     }
-    
-    std::cout << "Total operations: " << total_ops << std::endl;
-    std::cout << "Total failures: " << total_failures << std::endl;
-    
+
+    log << "Total operations: " << total_ops << std::endl;
+    log << "Total failures: " << total_failures << std::endl;
+
     if (total_ops > 0) {
-        std::cout << "SUCCESS: Simple test completed!" << std::endl;
-        
+        log << "SUCCESS: Simple test completed!" << std::endl;
+
         // Run SIMPLE queue validation first
-        std::cout << "\n=== Running Queue Logic Validation ===" << std::endl;
-        
+        log << "\n=== Running Queue Logic Validation ===" << std::endl;
+
         cl_kernel validate_kernel = clCreateKernel(program, "validate_queue_logic", &err);
         if (err != CL_SUCCESS) {
-            std::cout << "Could not create validate_queue_logic kernel, skipping..." << std::endl;
+            log << "Could not create validate_queue_logic kernel, skipping..." << std::endl;
         } else {
             // Re-initialize queue for clean test
-            if (queue_type == "sfq") {
-                std::vector<uint32_t> init_data(4096 * 3, 0);
-                clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
-            } else if (queue_type == "ms") {
-                ms_queue_layout init_queue = {};
-                init_queue.head.ptr = 1;
-                init_queue.head.count = 0;
-                init_queue.tail.ptr = 1;
-                init_queue.tail.count = 0;
-                
-                for (int i = 0; i < 4097; i++) {
-                    if (i == 1) {
-                        init_queue.nodes[i].free = 1;
-                        init_queue.nodes[i].value = 0;
-                        init_queue.nodes[i].next.ptr = 0;
-                        init_queue.nodes[i].next.count = 0;
-                    } else {
-                        init_queue.nodes[i].free = 0;
-                        init_queue.nodes[i].value = 0;
-                        init_queue.nodes[i].next.ptr = 0;
-                        init_queue.nodes[i].next.count = 0;
-                    }
-                }
-                
-                for (int i = 0; i < 1500; i++) {
-                    init_queue.hazard1[i] = UINT_MAX;
-                    init_queue.hazard2[i] = UINT_MAX;
-                }
-                
-                init_queue.base_spin = 0;
-                clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, sizeof(ms_queue_layout), &init_queue, 0, NULL, NULL);
-            } else if (queue_type == "tz") {
-                std::vector<uint32_t> init_data(4096 + 5, 0);
-                init_data[0] = 0;
-                init_data[1] = 1;
-                init_data[2] = 4294967295;
-                for (int i = 3; i < 4096 + 5; i++) {
-                    init_data[i] = 4294967294;
-                }
-                init_data[3] = 4294967295;
-                clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
-            }
-            
+            initQueueBuffer(command_queue, queue_buf, queue_type, queue_length, session.layout);
+
             // Create results buffer for 10 threads * 3 values each
             cl_mem validate_results_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 30 * sizeof(uint32_t), NULL, &err);
-            
+
             clSetKernelArg(validate_kernel, 0, sizeof(cl_mem), &queue_buf);
             clSetKernelArg(validate_kernel, 1, sizeof(cl_mem), &validate_results_buf);
-            
+
             // Launch 10 threads (1 producer, 9 consumers)
             size_t ten = 10;
             size_t local_ten = 10;
-            
-            std::cout << "Testing 1 producer + 9 consumers..." << std::endl;
-            
+
+            log << "Testing 1 producer + 9 consumers..." << std::endl;
+
             auto val_start = std::chrono::high_resolution_clock::now();
-            
+
             err = clEnqueueNDRangeKernel(command_queue, validate_kernel, 1, NULL, &ten, &local_ten, 0, NULL, NULL);
             if (err != CL_SUCCESS) {
-                std::cout << "Failed to launch validation kernel! Error: " << err << std::endl;
+                log << "Failed to launch validation kernel! Error: " << err << std::endl;
             } else {
                 clFinish(command_queue);
-                
+
                 auto val_end = std::chrono::high_resolution_clock::now();
                 auto val_duration = std::chrono::duration_cast<std::chrono::milliseconds>(val_end - val_start);
-                
+
                 // Read validation results
                 std::vector<uint32_t> val_results(30);
                 clEnqueueReadBuffer(command_queue, validate_results_buf, CL_TRUE, 0, 30 * sizeof(uint32_t), val_results.data(), 0, NULL, NULL);
-                
-                std::cout << "Validation completed in " << val_duration.count() << " ms" << std::endl;
-                
+
+                log << "Validation completed in " << val_duration.count() << " ms" << std::endl;
+
                 uint32_t total_produced = 0;
                 uint32_t total_consumed = 0;
                 uint32_t total_val_failures = 0;
-                
+
                 for (int i = 0; i < 10; i++) {
                     uint32_t ops = val_results[i * 3 + 0];
                     uint32_t failures = val_results[i * 3 + 1];
                     uint32_t thread_id = val_results[i * 3 + 2];
-                    
+
                     if (thread_id == 0) {
                         total_produced += ops;
-                        std::cout << "Producer (thread 0): produced=" << ops << ", failures=" << failures << std::endl;
+                        log << "Producer (thread 0): produced=" << ops << ", failures=" << failures << std::endl;
                     } else {
                         total_consumed += ops;
-                        std::cout << "Consumer " << thread_id << ": consumed=" << ops << ", failures=" << failures << std::endl;
+                        log << "Consumer " << thread_id << ": consumed=" << ops << ", failures=" << failures << std::endl;
                     }
-                    
+
                     total_val_failures += failures;
                 }
-                
-                std::cout << "\nValidation Summary:" << std::endl;
-                std::cout << "Total produced: " << total_produced << std::endl;
-                std::cout << "Total consumed: " << total_consumed << std::endl;
-                std::cout << "Total failures: " << total_val_failures << std::endl;
-                
+
+                log << "\nValidation Summary:" << std::endl;
+                log << "Total produced: " << total_produced << std::endl;
+                log << "Total consumed: " << total_consumed << std::endl;
+                log << "Total failures: " << total_val_failures << std::endl;
+
                 if (total_produced >= 15 && total_consumed >= 10) {
-                    std::cout << "SUCCESS: Queue logic works correctly!" << std::endl;
+                    log << "SUCCESS: Queue logic works correctly!" << std::endl;
                 } else {
-                    std::cout << "ISSUE: Queue may have problems - low throughput" << std::endl;
+                    log << "ISSUE: Queue may have problems - low throughput" << std::endl;
                 }
             }
-            
+
             clReleaseMemObject(validate_results_buf);
             clReleaseKernel(validate_kernel);
         }
-        
-        // NOW run the reordered throughput tests
-        runThroughputTest(context, command_queue, program, queue_type, queue_size, gpu_device);
+
+        TuneProfile profile;
+        std::string path = profilePath(options, session.device);
+        if (options.autotune) {
+            // Keep the entries of other queue types already in the profile
+            loadProfile(path, profile);
+            autotuneQueue(session, cache, queue_type, defaults, options, profile, log);
+            if (saveProfile(path, getGPUName(session.device), profile)) {
+                log << "Tuning profile written to " << path << std::endl;
+            } else {
+                log << "Could not write tuning profile " << path << std::endl;
+            }
+        } else {
+            if (options.use_profile && loadProfile(path, profile)) {
+                log << "Using tuning profile " << path << std::endl;
+            }
+
+            // NOW run the reordered throughput tests
+            std::vector<ThroughputResult> sweep = runThroughputTest(session, cache, queue_type, defaults, profile,
+                                                                       options.pipeline && !session.layout.telemetry
+                                                                           && !session.layout.trace, log);
+            results.insert(results.end(), sweep.begin(), sweep.end());
+
+            if (!options.copy_chunks.empty()) {
+                std::vector<CopyResult> copy = runCopyBenchmark(session, cache, queue_type, defaults, options, log);
+                copies.insert(copies.end(), copy.begin(), copy.end());
+            }
+        }
     } else {
-        std::cout << "FAILED: No operations completed in simple test" << std::endl;
+        log << "FAILED: No operations completed in simple test" << std::endl;
     }
-    
+
     // Cleanup
     clReleaseKernel(kernel);
     clReleaseMemObject(barrier_buf);
     clReleaseMemObject(queue_buf);
     clReleaseMemObject(metrics_buf);
     clReleaseMemObject(timing_buf);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(command_queue);
-    clReleaseContext(context);
-    
+    cache.release();
+
+    return total_ops > 0;
+}
+
+void printUsage(const char* prog) {
+    std::cout << "Usage: " << prog << " <queue_type> [--all-devices | --devices=i,j,...] [--list-devices]"
+              << " [--autotune] [--tune-budget=N] [--tune-threads=N] [--profile=PATH] [--no-profile]"
+              << " [--sfq-layout=split|aos|padded] [--sfq-swizzle=N|auto|none] [--sfq-line-words=N]"
+              << " [--tz-scan=1|4|8] [--cl2-atomics=auto|on|off]"
+              << " [--queue-length=N] [--ms-wide] [--grid-barrier] [--no-pipeline]"
+              << " [--telemetry[=PREFIX]] [--telemetry-samples=N]"
+              << " [--trace[=PREFIX]] [--trace-events=N] [--trace-timer] [--workload=FILE]"
+              << " [--copy-chunks=N,...|none] [--copy-elements=N]" << std::endl;
+    std::cout << "queue_type: sfq, ms, tz, wfq, all" << std::endl;
+    std::cout << "  --all-devices     run the sweep concurrently on every OpenCL device (GPU, CPU, ...)" << std::endl;
+    std::cout << "  --devices=LIST    run concurrently on the listed device indices (see --list-devices)" << std::endl;
+    std::cout << "  --list-devices    print the device indices and exit" << std::endl;
+    std::cout << "  --autotune        search queue length, failsafe, backoff and local size per test/pattern" << std::endl;
+    std::cout << "                    and store the best configuration in the device profile" << std::endl;
+    std::cout << "  --tune-budget=N   kernel launches per test/pattern during autotuning (default 64)" << std::endl;
+    std::cout << "  --tune-threads=N  thread count used while autotuning (default 512)" << std::endl;
+    std::cout << "  --profile=PATH    tuning profile to read/write (default queue_tuning_<device>.profile)" << std::endl;
+    std::cout << "  --no-profile      ignore any tuning profile and use the built-in defaults" << std::endl;
+    std::cout << "  --sfq-layout=L    SFQ cell layout: split (items[]/slots[]), aos ({slot,item} pairs)" << std::endl;
+    std::cout << "                    or padded (one cache line per pair)" << std::endl;
+    std::cout << "  --sfq-swizzle=N   SFQ ticket swizzle stride: power of two, auto (cache line) or none" << std::endl;
+    std::cout << "  --sfq-line-words=N  cache line in 4-byte words for padding (default: device cache line)" << std::endl;
+    std::cout << "  --tz-scan=W       TZ tail/head search width: 1 (cell by cell), 4 or 8 (uint4/uint8 loads)" << std::endl;
+    std::cout << "  --cl2-atomics=M   OpenCL 2.0 acquire/release atomics: off (default, OpenCL 1.2 atomic_*" << std::endl;
+    std::cout << "                    builtins), on, or auto (if the device supports OpenCL C 2.0)" << std::endl;
+    std::cout << "  --grid-barrier    grid-wide phases in burst_pattern_test and workload specs: discover the" << std::endl;
+    std::cout << "                    co-resident work-groups and sync them with a sense-reversing barrier" << std::endl;
+    std::cout << "  --no-pipeline     run the sweep serially (blocking transfers, host-timed kernels)" << std::endl;
+    std::cout << "  --telemetry[=P]   sample queue depth, ops and queue retries while each sweep kernel runs" << std::endl;
+    std::cout << "                    into P_<device>.csv (default prefix: telemetry); runs the sweep serially" << std::endl;
+    std::cout << "  --telemetry-samples=N  telemetry ring capacity in samples (default 4096)" << std::endl;
+    std::cout << "  --trace[=P]       record per work-group op/retry/phase/barrier events of each sweep kernel" << std::endl;
+    std::cout << "                    as a Chrome trace in P_<device>.json (default prefix: trace); runs serially" << std::endl;
+    std::cout << "  --trace-events=N  trace ring capacity in events, the newest are kept (default 65536)" << std::endl;
+    std::cout << "  --trace-timer     timestamp with the NVIDIA global timer instead of the logical clock" << std::endl;
+    std::cout << "  --workload=FILE   also sweep the workloads of a spec file (see workloads/*.wl) with" << std::endl;
+    std::cout << "                    the table-driven workload_test kernel; may be repeated" << std::endl;
+    std::cout << "  --copy-chunks=L   chunk sizes (ints) of the bulk copy test (default 64,256,1024,4096);" << std::endl;
+    std::cout << "                    none skips it" << std::endl;
+    std::cout << "  --copy-elements=N ints moved through the queue per bulk copy run (default 1048576)" << std::endl;
+    std::cout << "  --queue-length=N  queue capacity for the default configuration, a power of two >= 8 (default 4096)" << std::endl;
+    std::cout << "  --ms-wide         MS queue with 64-bit pointers (32-bit index and ABA tag); implied" << std::endl;
+    std::cout << "                    for MS when --queue-length exceeds 65535" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string queue_type = argv[1];
+    RunOptions options;
+    bool all_devices = false;
+    bool list_devices = false;
+    std::vector<int> device_indices;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--all-devices") {
+            all_devices = true;
+        } else if (arg == "--list-devices") {
+            list_devices = true;
+        } else if (arg == "--autotune") {
+            options.autotune = true;
+        } else if (arg.compare(0, 14, "--tune-budget=") == 0) {
+            options.tune_budget = std::max(1, atoi(arg.c_str() + 14));
+        } else if (arg.compare(0, 15, "--tune-threads=") == 0) {
+            options.tune_threads = std::max(1, atoi(arg.c_str() + 15));
+        } else if (arg.compare(0, 10, "--profile=") == 0) {
+            options.profile_path = arg.substr(10);
+        } else if (arg == "--no-profile") {
+            options.use_profile = false;
+        } else if (arg.compare(0, 13, "--sfq-layout=") == 0) {
+            options.sfq_layout = arg.substr(13);
+            if (options.sfq_layout != "split" && options.sfq_layout != "aos" && options.sfq_layout != "padded") {
+                std::cerr << "Error: --sfq-layout must be split, aos or padded" << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 14, "--sfq-swizzle=") == 0) {
+            std::string value = arg.substr(14);
+            options.sfq_swizzle = value == "auto" ? 0 : value == "none" ? 1 : atoi(value.c_str());
+            if (options.sfq_swizzle < 0 || (options.sfq_swizzle & (options.sfq_swizzle - 1)) != 0) {
+                std::cerr << "Error: --sfq-swizzle must be a power of two, auto or none" << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 17, "--sfq-line-words=") == 0) {
+            options.sfq_line_words = std::max(2, atoi(arg.c_str() + 17));
+        } else if (arg.compare(0, 10, "--tz-scan=") == 0) {
+            options.tz_scan_width = atoi(arg.c_str() + 10);
+            if (options.tz_scan_width != 1 && options.tz_scan_width != 4 && options.tz_scan_width != 8) {
+                std::cerr << "Error: --tz-scan must be 1, 4 or 8" << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 14, "--cl2-atomics=") == 0) {
+            std::string value = arg.substr(14);
+            if (value != "auto" && value != "on" && value != "off") {
+                std::cerr << "Error: --cl2-atomics must be auto, on or off" << std::endl;
+                return 1;
+            }
+            options.cl2_atomics = value == "auto" ? -1 : value == "on" ? 1 : 0;
+        } else if (arg.compare(0, 15, "--queue-length=") == 0) {
+            int length = atoi(arg.c_str() + 15);
+            // SFQ masks and shifts tickets, TZ scans in chunks of up to 8 cells
+            if (length < 8 || (length & (length - 1)) != 0) {
+                std::cerr << "Error: --queue-length must be a power of two of at least 8" << std::endl;
+                return 1;
+            }
+            options.queue_length = (unsigned)length;
+        } else if (arg == "--telemetry") {
+            options.telemetry = "telemetry";
+        } else if (arg.compare(0, 12, "--telemetry=") == 0) {
+            options.telemetry = arg.substr(12);
+        } else if (arg.compare(0, 20, "--telemetry-samples=") == 0) {
+            options.telemetry_samples = (unsigned)std::max(1, atoi(arg.c_str() + 20));
+        } else if (arg == "--trace") {
+            options.trace = "trace";
+        } else if (arg.compare(0, 8, "--trace=") == 0) {
+            options.trace = arg.substr(8);
+        } else if (arg.compare(0, 15, "--trace-events=") == 0) {
+            options.trace_events = (unsigned)std::max(1, atoi(arg.c_str() + 15));
+        } else if (arg == "--trace-timer") {
+            options.trace_timer = true;
+        } else if (arg.compare(0, 11, "--workload=") == 0) {
+            std::string error;
+            if (!loadWorkloads(arg.substr(11), options.workloads, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 14, "--copy-chunks=") == 0) {
+            options.copy_chunks.clear();
+            std::string value = arg.substr(14);
+            if (value != "none") {
+                std::stringstream ss(value);
+                std::string chunk;
+                while (std::getline(ss, chunk, ',')) {
+                    options.copy_chunks.push_back(std::max(1, atoi(chunk.c_str())));
+                }
+            }
+        } else if (arg.compare(0, 16, "--copy-elements=") == 0) {
+            options.copy_elements = (unsigned)std::max(1, atoi(arg.c_str() + 16));
+        } else if (arg == "--no-pipeline") {
+            options.pipeline = false;
+        } else if (arg == "--ms-wide") {
+            options.ms_wide = true;
+        } else if (arg == "--grid-barrier") {
+            options.grid_barrier = true;
+        } else if (arg.compare(0, 10, "--devices=") == 0) {
+            std::stringstream ss(arg.substr(10));
+            std::string idx;
+            while (std::getline(ss, idx, ',')) {
+                device_indices.push_back(atoi(idx.c_str()));
+            }
+        } else {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (queue_type == "--list-devices") {
+        list_devices = true;
+    } else if (queue_type != "sfq" && queue_type != "ms" && queue_type != "tz" && queue_type != "wfq" &&
+               queue_type != "all") {
+        std::cerr << "Error: queue_type must be sfq, ms, tz, wfq, or all" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> queue_types;
+    if (queue_type == "all") {
+        queue_types = {"sfq", "ms", "tz", "wfq"};
+    } else {
+        queue_types = {queue_type};
+    }
+
+    // 16-bit MS pointers cannot index more than 65535 nodes
+    if (options.queue_length > MS_NARROW_MAX_LENGTH && !options.ms_wide &&
+        std::find(queue_types.begin(), queue_types.end(), "ms") != queue_types.end()) {
+        std::cout << "Queue length " << options.queue_length << " needs 64-bit MS pointers, enabling --ms-wide" << std::endl;
+        options.ms_wide = true;
+    }
+
+    if (list_devices) {
+        std::vector<cl_device_id> devices = enumerateDevices(CL_DEVICE_TYPE_ALL);
+        for (size_t i = 0; i < devices.size(); i++) {
+            std::cout << i << ": " << getGPUName(devices[i]) << " [" << getDeviceTypeName(devices[i])
+                      << ", " << getVendorName(devices[i]) << "]" << std::endl;
+        }
+        return 0;
+    }
+
+    // Multi-device mode: one host thread and one context per device, results merged afterwards
+    if (all_devices || !device_indices.empty()) {
+        std::vector<cl_device_id> available = enumerateDevices(CL_DEVICE_TYPE_ALL);
+        if (available.empty()) {
+            std::cerr << "No OpenCL devices found!" << std::endl;
+            return 1;
+        }
+
+        std::vector<cl_device_id> selected;
+        if (all_devices) {
+            selected = available;
+        } else {
+            for (int idx : device_indices) {
+                if (idx < 0 || idx >= (int)available.size()) {
+                    std::cerr << "Error: device index " << idx << " out of range (0-" << available.size() - 1 << ")" << std::endl;
+                    return 1;
+                }
+                selected.push_back(available[idx]);
+            }
+        }
+
+        std::vector<std::string> labels(selected.size());
+        std::vector<std::ostringstream> logs(selected.size());
+        std::vector<std::vector<ThroughputResult>> per_device(selected.size());
+        std::vector<std::vector<CopyResult>> per_device_copies(selected.size());
+        std::vector<std::thread> workers;
+
+        for (size_t d = 0; d < selected.size(); d++) {
+            labels[d] = std::to_string(d) + ":" + getGPUName(selected[d]);
+            std::cout << "Using " << getDeviceTypeName(selected[d]) << ": " << labels[d] << std::endl;
+        }
+
+        for (size_t d = 0; d < selected.size(); d++) {
+            workers.emplace_back([&, d]() {
+                DeviceSession session;
+                if (!openDeviceSession(selected[d], labels[d], options, session, logs[d])) {
+                    return;
+                }
+                for (const auto& qt : queue_types) {
+                    runQueueBenchmarks(session, qt, options, logs[d], per_device[d], per_device_copies[d]);
+                }
+                closeDeviceSession(session);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        std::vector<ThroughputResult> merged;
+        std::vector<CopyResult> merged_copies;
+        for (size_t d = 0; d < selected.size(); d++) {
+            std::cout << "\n##### Device " << labels[d] << " #####" << std::endl;
+            std::cout << logs[d].str();
+            merged.insert(merged.end(), per_device[d].begin(), per_device[d].end());
+            merged_copies.insert(merged_copies.end(), per_device_copies[d].begin(), per_device_copies[d].end());
+        }
+
+        printAggregatedReport(labels, merged, merged_copies);
+        return 0;
+    }
+
+    // Get GPU device
+    std::vector<cl_device_id> gpus = enumerateDevices(CL_DEVICE_TYPE_GPU);
+    if (gpus.empty()) {
+        std::cerr << "No GPU devices found!" << std::endl;
+        return 1;
+    }
+    cl_device_id gpu_device = gpus[0];
+
+    std::string gpu_name = getGPUName(gpu_device);
+    std::cout << "Using GPU: " << gpu_name << std::endl;
+
+    DeviceSession session;
+    if (!openDeviceSession(gpu_device, gpu_name, options, session, std::cerr)) {
+        return 1;
+    }
+
+    std::vector<ThroughputResult> results;
+    std::vector<CopyResult> copies;
+    for (const auto& qt : queue_types) {
+        runQueueBenchmarks(session, qt, options, std::cout, results, copies);
+    }
+
+    closeDeviceSession(session);
+
     return 0;
 }
 
-void runThroughputTest(cl_context context, cl_command_queue command_queue, cl_program program, 
-                      const std::string& queue_type, size_t queue_size, cl_device_id device) {
-    
-    std::cout << "\n=== Running Throughput Tests ===" << std::endl;
-    
+// Merge per-device results into one table. Each configuration is compared
+// against the fastest device for that configuration (scaling efficiency).
+void printAggregatedReport(const std::vector<std::string>& device_labels,
+                           const std::vector<ThroughputResult>& results,
+                           const std::vector<CopyResult>& copies) {
+    typedef std::tuple<std::string, std::string, int, int> ConfigKey;
+    std::map<ConfigKey, std::map<std::string, double>> by_config;
+    std::map<ConfigKey, std::map<std::string, int>> active;
+    for (const auto& r : results) {
+        std::string queue = r.variant.empty() ? r.queue_type : r.queue_type + "[" + r.variant + "]";
+        ConfigKey key(queue, r.test_name, r.threads, r.pattern);
+        by_config[key][r.device] = r.throughput;
+        if (r.active_threads != r.threads) active[key][r.device] = r.active_threads;
+    }
+
+    std::cout << "\n=== Aggregated Multi-Device Report ===" << std::endl;
+    std::cout << std::left << std::setw(24) << "queue" << std::setw(26) << "test"
+              << std::setw(8) << "threads" << std::setw(8) << "pattern";
+    for (const auto& label : device_labels) {
+        std::cout << " | " << std::setw(30) << label;
+    }
+    std::cout << std::endl;
+
+    // Per (queue, device): sum of efficiencies, sum of log throughput, count
+    std::map<std::string, std::map<std::string, double>> eff_sum;
+    std::map<std::string, std::map<std::string, double>> log_sum;
+    std::map<std::string, std::map<std::string, int>> count;
+
+    for (const auto& entry : by_config) {
+        const ConfigKey& key = entry.first;
+        double fastest = 0;
+        for (const auto& dev : entry.second) {
+            fastest = std::max(fastest, dev.second);
+        }
+
+        std::cout << std::left << std::setw(24) << std::get<0>(key) << std::setw(26) << std::get<1>(key)
+                  << std::setw(8) << std::get<2>(key) << std::setw(8) << std::get<3>(key);
+        for (const auto& label : device_labels) {
+            auto it = entry.second.find(label);
+            std::ostringstream cell;
+            if (it == entry.second.end()) {
+                cell << "-";
+            } else {
+                double eff = fastest > 0 ? it->second / fastest : 0;
+                cell << std::scientific << std::setprecision(3) << it->second << " ops/s ("
+                     << std::fixed << std::setprecision(1) << eff * 100 << "%)";
+                auto occ = active[key].find(label);
+                if (occ != active[key].end()) cell << " @" << occ->second;
+                eff_sum[std::get<0>(key)][label] += eff;
+                log_sum[std::get<0>(key)][label] += std::log(std::max(it->second, 1.0));
+                count[std::get<0>(key)][label]++;
+            }
+            std::cout << " | " << std::setw(30) << cell.str();
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "\n=== Per-Queue Device Summary ===" << std::endl;
+    for (const auto& queue_entry : count) {
+        const std::string& qt = queue_entry.first;
+        std::string best_device;
+        double best_eff = -1;
+        for (const auto& dev : queue_entry.second) {
+            double mean_eff = eff_sum[qt][dev.first] / dev.second;
+            double geo_mean = std::exp(log_sum[qt][dev.first] / dev.second);
+            std::cout << qt << " on " << dev.first
+                      << ": mean efficiency " << std::fixed << std::setprecision(1) << mean_eff * 100 << "%"
+                      << ", geomean throughput " << std::scientific << std::setprecision(3) << geo_mean << " ops/sec"
+                      << " (" << dev.second << " configs)" << std::endl;
+            if (mean_eff > best_eff) {
+                best_eff = mean_eff;
+                best_device = dev.first;
+            }
+        }
+        std::cout << "Best device for " << qt << ": " << best_device << std::endl;
+    }
+
+    // Bulk copy runs have their own row: chunk size instead of threads/pattern
+    if (!copies.empty()) {
+        typedef std::pair<std::string, int> CopyKey;
+        std::map<CopyKey, std::map<std::string, const CopyResult*>> by_chunk;
+        for (const auto& c : copies) {
+            std::string queue = c.variant.empty() ? c.queue_type : c.queue_type + "[" + c.variant + "]";
+            by_chunk[CopyKey(queue, c.chunk)][c.device] = &c;
+        }
+        std::cout << "\n=== Bulk Copy Report ===" << std::endl;
+        std::cout << std::left << std::setw(24) << "queue" << std::setw(12) << "chunk ints";
+        for (const auto& label : device_labels) {
+            std::cout << " | " << std::setw(30) << label;
+        }
+        std::cout << std::endl;
+        for (const auto& entry : by_chunk) {
+            std::cout << std::left << std::setw(24) << entry.first.first << std::setw(12) << entry.first.second;
+            for (const auto& label : device_labels) {
+                auto it = entry.second.find(label);
+                std::ostringstream cell;
+                if (it == entry.second.end()) {
+                    cell << "-";
+                } else {
+                    cell << std::fixed << std::setprecision(2) << it->second->gbps << " GB/s "
+                         << std::scientific << std::setprecision(3) << it->second->ints_per_sec << " ints/s";
+                }
+                std::cout << " | " << std::setw(30) << cell.str();
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout << std::defaultfloat;
+}
+
+// Append one run's events to the session's Chrome trace. Each run is a
+// process and each work-group a thread; timestamps are the device timer in
+// microseconds when available, else the logical clock (one tick per event).
+void appendChromeTrace(DeviceSession& session, const std::string& queue_type, const std::string& variant,
+                       const SweepRun& run, const std::vector<TraceEvent>& events) {
+    std::ofstream json(session.trace_path, std::ios::app);
+    const unsigned pid = session.trace_runs++;
+    json << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+         << ",\"args\":{\"name\":\"" << queue_type << (variant.empty() ? "" : " " + variant) << " " << run.test_name
+         << " threads=" << run.threads << " pattern=" << run.pattern << "\"}}," << std::endl;
+
+    const uint32_t first_time = events.front().time;
+    for (const TraceEvent& e : events) {
+        double ts = session.trace_timer ? (uint32_t)(e.time - first_time) / 1000.0 : (double)e.seq;
+        json << "{\"pid\":" << pid << ",\"tid\":" << e.group << ",\"ts\":" << ts << ",";
+        switch (e.kind) {
+        case TRACE_OP_BEGIN:
+            json << "\"name\":\"op\",\"ph\":\"B\"";
+            break;
+        case TRACE_OP_END:
+            json << "\"name\":\"op\",\"ph\":\"E\",\"args\":{\"retries\":" << e.arg << "}";
+            break;
+        case TRACE_PHASE:
+            json << "\"name\":\"phase " << e.arg << "\",\"ph\":\"i\",\"s\":\"t\"";
+            break;
+        case TRACE_BARRIER_ENTER:
+            json << "\"name\":\"full_init\",\"ph\":\"B\"";
+            break;
+        case TRACE_BARRIER_EXIT:
+            json << "\"name\":\"full_init\",\"ph\":\"E\"";
+            break;
+        default:
+            json << "\"name\":\"event " << e.kind << "\",\"ph\":\"i\",\"s\":\"t\"";
+            break;
+        }
+        json << "}," << std::endl;
+    }
+}
+
+std::vector<ThroughputResult> runThroughputTest(DeviceSession& session, ProgramCache& cache,
+                      const std::string& queue_type, const TuneConfig& defaults,
+                      const TuneProfile& profile, bool pipelined, std::ostream& log) {
+
+    std::vector<ThroughputResult> results;
+    log << "\n=== Running Throughput Tests ===" << std::endl;
+
     // Test configurations - REORDERED: lightest to heaviest workloads
     std::vector<std::string> test_names = {
         "scheduler_simulation",      // Lightest - mixed producer/consumer
-        "bfs_simulation",           // Medium - graph traversal pattern  
+        "bfs_simulation",           // Medium - graph traversal pattern
         "burst_pattern_test",       // Heavy - burst loads
         "contention_pattern_test"   // HEAVIEST - high contention (do this LAST)
     };
-    
-    std::vector<int> thread_counts = {64, 128, 256, 512};
+
+    std::vector<int> thread_counts = SWEEP_THREAD_COUNTS;
     std::vector<int> pattern_types = {0, 1,2,3};
-    
+    // --workload specs run last, one pattern per workload in the table
+    if (session.workload_table != NULL) {
+        test_names.push_back("workload_test");
+    }
+    const std::string variant = queueVariantName(queue_type, session.layout);
+
+    // Report a finished run; the pipeline delivers them in submission order
+    std::string current_test;
+    auto harvest = [&](const SweepRun& run, bool ok, const RunCounts& counts) {
+        if (run.test_name != current_test) {
+            current_test = run.test_name;
+            log << "\n--- Running " << run.test_name << " ---" << std::endl;
+        }
+        if (!ok) {
+            log << "Failed to run " << run.test_name << " with " << run.threads << " threads, pattern " << run.pattern << std::endl;
+            return;
+        }
+        // Dropped operations make the op count and throughput meaningless
+        if (counts.failed_ops > 0) {
+            log << "Failed run " << run.test_name << " with " << run.threads << " threads, pattern " << run.pattern
+                << ": " << counts.failed_ops << " operations gave up after FAILSAFE (" << counts.total_ops
+                << " completed)" << std::endl;
+            return;
+        }
+        double throughput = counts.total_ops / (counts.time_us / 1000000.0);
+
+        log << run.test_name << " - Threads: " << run.threads
+                 << ", Pattern: " << run.pattern
+                 << ", Ops: " << counts.total_ops
+                 << ", Time: " << counts.time_us << "us"
+                 << ", Throughput: " << throughput << " ops/sec";
+        // Under GRID_BARRIER only the co-resident groups do work, so per-thread
+        // figures are based on the occupant count rather than the launch size
+        if (counts.active_threads != (uint32_t)run.threads) {
+            log << ", Active: " << counts.active_threads
+                << ", Ops/work-item: " << counts.total_ops / std::max(counts.active_threads, 1u);
+        }
+        if (!variant.empty()) {
+            log << ", Layout: " << variant;
+        }
+        if (run.tuned) {
+            log << " [tuned: queue_length=" << run.config.queue_length
+                << " failsafe=" << run.config.failsafe
+                << " work=" << run.config.work
+                << " local_size=" << run.config.local_size << "]";
+        }
+        log << std::endl;
+
+        results.push_back({session.label, queue_type, run.test_name, variant, run.threads,
+                           (int)counts.active_threads, run.pattern, counts.total_ops, counts.time_us, throughput});
+    };
+
+    SweepPipeline pipeline;
+    pipeline.session = &session;
+    pipeline.queue_type = queue_type;
+    pipeline.harvest = harvest;
+
     for (const auto& test_name : test_names) {
-        std::cout << "\n--- Running " << test_name << " ---" << std::endl;
-        
-        cl_int err;
-        cl_kernel kernel = clCreateKernel(program, test_name.c_str(), &err);
-        if (err != CL_SUCCESS) {
-            std::cout << "Kernel " << test_name << " not available, skipping..." << std::endl;
-            continue;
+        const bool workload = test_name == "workload_test";
+        std::vector<int> patterns = pattern_types;
+        if (workload) {
+            patterns.clear();
+            for (size_t w = 0; w < session.workloads.size(); w++) {
+                patterns.push_back((int)w);
+            }
         }
-        
         for (int threads : thread_counts) {
-            for (int pattern : pattern_types) {
-                // Create buffers
-                const size_t barrier_size = 1000 * sizeof(uint32_t);
-                const int operations = 1000;  // Reduced from 1000 to 128 for RTX 3090
-                
-                cl_mem barrier_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, barrier_size, NULL, &err);
-                cl_mem queue_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, queue_size, NULL, &err);
-                cl_mem metrics_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, threads * sizeof(uint32_t), NULL, &err);
-                cl_mem timing_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 10 * sizeof(uint64_t), NULL, &err);
-                
-                bool test_success = false;
-                
-                // Initialize queue (same as before)
-                if (queue_type == "sfq") {
-                    std::vector<uint32_t> init_data(4096 * 3, 0);
-                    clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
-                } else if (queue_type == "ms") {
-                    ms_queue_layout init_queue = {};
-                    init_queue.head.ptr = 1;
-                    init_queue.head.count = 0;
-                    init_queue.tail.ptr = 1;
-                    init_queue.tail.count = 0;
-                    
-                    for (int i = 0; i < 4097; i++) {
-                        if (i == 1) {
-                            init_queue.nodes[i].free = 1;
-                            init_queue.nodes[i].value = 0;
-                            init_queue.nodes[i].next.ptr = 0;
-                            init_queue.nodes[i].next.count = 0;
-                        } else {
-                            init_queue.nodes[i].free = 0;
-                            init_queue.nodes[i].value = 0;
-                            init_queue.nodes[i].next.ptr = 0;
-                            init_queue.nodes[i].next.count = 0;
-                        }
-                    }
-                    
-                    for (int i = 0; i < 1500; i++) {
-                        init_queue.hazard1[i] = UINT_MAX;
-                        init_queue.hazard2[i] = UINT_MAX;
-                    }
-                    
-                    init_queue.base_spin = 0;
-                    clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, sizeof(ms_queue_layout), &init_queue, 0, NULL, NULL);
-                } else if (queue_type == "tz") {
-                    std::vector<uint32_t> init_data(4096 + 5, 0);
-                    init_data[0] = 0;
-                    init_data[1] = 1;
-                    init_data[2] = 4294967295;
-                    for (int i = 3; i < 4096 + 5; i++) {
-                        init_data[i] = 4294967294;
-                    }
-                    init_data[3] = 4294967295;
-                    clEnqueueWriteBuffer(command_queue, queue_buf, CL_TRUE, 0, init_data.size() * sizeof(uint32_t), init_data.data(), 0, NULL, NULL);
+            for (int pattern : patterns) {
+                // Tuned configuration for this test and pattern, if the profile has one
+                TuneConfig config = defaults;
+                auto tuned = profile.find(profileKey(queue_type, variant, threads, test_name, pattern));
+                if (tuned != profile.end()) {
+                    config = tuned->second.config;
+                }
+
+                cl_program program = cache.get(makeBuildOptions(queue_type, session, config), log);
+                if (program == NULL) {
+                    log << "Failed to build " << test_name << " for pattern " << pattern << std::endl;
+                    continue;
+                }
+
+                cl_int err;
+                cl_kernel kernel = clCreateKernel(program, test_name.c_str(), &err);
+                if (err != CL_SUCCESS) {
+                    log << "Kernel " << test_name << " not available, skipping..." << std::endl;
+                    continue;
+                }
+
+                // Arguments 0-5 are set per launch; the table stays bound to the kernel
+                if (workload) {
+                    clSetKernelArg(kernel, 6, sizeof(cl_mem), &session.workload_table);
                 }
-                
-                // Initialize barrier
-                std::vector<uint32_t> barrier_data(1000, 0);
-                clEnqueueWriteBuffer(command_queue, barrier_buf, CL_TRUE, 0, barrier_size, barrier_data.data(), 0, NULL, NULL);
-                
-                // FIX 1: Initialize barrier properly to prevent deadlock
-                cl_kernel barr = clCreateKernel(program, "barrier_init", &err);
-                if (err == CL_SUCCESS) {
-                    size_t one = 1;
-                    clSetKernelArg(barr, 0, sizeof(cl_mem), &barrier_buf);
-                    clSetKernelArg(barr, 1, sizeof(uint32_t), &threads);  // grid x-dim
-                    clSetKernelArg(barr, 2, sizeof(uint32_t), &one);      // grid y-dim = 1
-                    clEnqueueNDRangeKernel(command_queue, barr, 1, NULL, &one, &one, 0, NULL, NULL);
-                    clFinish(command_queue);
-                    clReleaseKernel(barr);
+
+                SweepRun run = {workload ? "workload:" + session.workloads[pattern].name : test_name,
+                                threads, pattern, config, tuned != profile.end()};
+                if (pipelined) {
+                    pipeline.submit(program, kernel, run);
+                    continue;
                 }
-                
-                // Set kernel arguments
-                clSetKernelArg(kernel, 0, sizeof(cl_mem), &barrier_buf);
-                clSetKernelArg(kernel, 1, sizeof(cl_mem), &queue_buf);
-                clSetKernelArg(kernel, 2, sizeof(cl_mem), &metrics_buf);
-                clSetKernelArg(kernel, 3, sizeof(cl_mem), &timing_buf);
-                clSetKernelArg(kernel, 4, sizeof(int), &pattern);
-                clSetKernelArg(kernel, 5, sizeof(int), &operations);
-                
-                // Launch kernel
-                size_t global_size = threads;
-                size_t local_size = std::min(threads, 256);
-                while (global_size % local_size != 0) local_size--;
-                
-                auto start = std::chrono::high_resolution_clock::now();
-                
-                err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
-                if (err == CL_SUCCESS) {
-                    clFinish(command_queue);
-                    
-                    auto end = std::chrono::high_resolution_clock::now();
-                    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-                    
-                    // Read results
-                    std::vector<uint32_t> metrics_data(threads);
-                    clEnqueueReadBuffer(command_queue, metrics_buf, CL_TRUE, 0, threads * sizeof(uint32_t), metrics_data.data(), 0, NULL, NULL);
-                    
-                    uint32_t total_ops = 0;
-                    for (uint32_t ops : metrics_data) {
-                        total_ops += ops;
+
+                RunCounts counts;
+                RunCapture capture;
+                bool capturing = session.layout.telemetry || session.layout.trace;
+                bool ok = runSingleConfig(session, program, kernel, queue_type, config.queue_length,
+                                          threads, pattern, config.local_size, counts,
+                                          capturing ? &capture : NULL);
+                harvest(run, ok, counts);
+                clReleaseKernel(kernel);
+
+                const std::vector<TelemetrySample>& samples = capture.telemetry;
+                if (!samples.empty()) {
+                    std::ofstream csv(session.telemetry_path, std::ios::app);
+                    for (const TelemetrySample& sample : samples) {
+                        csv << queue_type << "," << run.test_name << "," << variant << ","
+                            << threads << "," << pattern << "," << sample.host_us << ","
+                            << sample.seq << "," << sample.group << "," << sample.depth << ","
+                            << sample.ops << "," << sample.retries << "\n";
                     }
-                    
-                    double throughput = total_ops / (duration.count() / 1000000.0);
-                    
-                    std::cout << test_name << " - Threads: " << threads 
-                             << ", Pattern: " << pattern 
-                             << ", Ops: " << total_ops 
-                             << ", Time: " << duration.count() << "us"
-                             << ", Throughput: " << throughput << " ops/sec" << std::endl;
-                    
-                    test_success = true;
-                } else {
-                    std::cout << "Failed to launch " << test_name << " with " << threads << " threads, pattern " << pattern << std::endl;
+                    log << "Telemetry: " << samples.size() << " samples" << std::endl;
+                }
+                if (!capture.trace.empty()) {
+                    appendChromeTrace(session, queue_type, variant, run, capture.trace);
+                    log << "Trace: " << capture.trace.size() << " events" << std::endl;
                 }
-                
-                // Cleanup buffers
-                clReleaseMemObject(barrier_buf);
-                clReleaseMemObject(queue_buf);
-                clReleaseMemObject(metrics_buf);
-                clReleaseMemObject(timing_buf);
             }
         }
-        
-        clReleaseKernel(kernel);
     }
-}
\ No newline at end of file
+    pipeline.release();
+
+    return results;
+}
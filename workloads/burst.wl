@@ -0,0 +1,17 @@
+# burst_pattern_test: balanced phases around an all-producer burst, and
+# periodic high/low activity cycles; the burst scales with the run
+# (total_operations / (2 * threads) per thread), the other counts are fixed
+
+workload burst_enqueue
+phase producers=50 consumers=50 ops=1 repeat=2 sync blocking
+phase producers=100 consumers=0 ops=50% sync
+phase producers=50 consumers=50 ops=1 repeat=2 sync blocking
+
+workload periodic_load
+phase producers=50 consumers=50 ops=3 sync blocking
+phase producers=50 consumers=50 ops=1 repeat=2 sync blocking
+phase producers=50 consumers=50 ops=3 sync blocking
+phase producers=50 consumers=50 ops=1 repeat=2 sync blocking
+phase producers=50 consumers=50 ops=3 sync blocking
+phase producers=50 consumers=50 ops=1 repeat=2 sync blocking
+phase producers=50 consumers=50 ops=3 sync blocking
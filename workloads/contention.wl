@@ -0,0 +1,14 @@
+# Producer/consumer mixes of contention_pattern_test
+# phase keys: producers=% consumers=% (rest alternate enqueue/dequeue),
+#             ops=N per thread, consumer_ops=N, work=N per dequeued item,
+#             gap=N spin before the phase, repeat=N, sync, blocking
+# ops=N% / consumer_ops=N% scale with the run: N% of total_operations / threads
+
+workload consumer_heavy
+phase producers=25 consumers=75 ops=1200% consumer_ops=133% blocking
+
+workload balanced
+phase producers=50 consumers=50 ops=100% blocking
+
+workload mixed
+phase producers=0 consumers=0 ops=100% blocking
@@ -0,0 +1,9 @@
+# scheduler_simulation: work stealing and a priority-like mix of item costs,
+# sized like the kernel from total_operations / threads
+
+workload work_stealing
+phase producers=25 consumers=75 ops=400% consumer_ops=100% work=100
+
+workload priority
+phase producers=50 consumers=50 ops=30% work=50 blocking
+phase producers=50 consumers=50 ops=70% work=200 blocking